@@ -0,0 +1,165 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace beehive::bench;
+
+// What Pool is measured against: std::async, and the thread pool everybody
+// writes first, with one locked queue of std::function and a condition
+// variable.
+namespace {
+const std::vector<size_t> FANOUT = {1000, 10000};
+const std::vector<size_t> PRODUCERS = {1, 2, 4, 8};
+const std::vector<size_t> ROUNDTRIPS = {1000, 10000};
+constexpr size_t TASKS = 100000;
+constexpr size_t SCALING = 1 << 16;
+
+class NaivePool {
+    public:
+        explicit NaivePool(size_t n = std::thread::hardware_concurrency()) {
+            for (size_t i = 0; i < std::max<size_t>(1, n); ++i) {
+                mThreads.emplace_back([this] () -> void { loop(); });
+            }
+        }
+
+        ~NaivePool() {
+            {
+                std::unique_lock<std::mutex> lk(mMutex);
+                mDone = true;
+            }
+            mWakeup.notify_all();
+            for (auto& t : mThreads) t.join();
+        }
+
+        std::future<void> schedule(std::function<void()> f) {
+            std::packaged_task<void()> task(std::move(f));
+            auto future = task.get_future();
+            {
+                std::unique_lock<std::mutex> lk(mMutex);
+                mTasks.push(std::move(task));
+            }
+            mWakeup.notify_one();
+            return future;
+        }
+
+    private:
+        void loop() {
+            while (true) {
+                std::packaged_task<void()> task;
+                {
+                    std::unique_lock<std::mutex> lk(mMutex);
+                    mWakeup.wait(lk, [this] () -> bool { return mDone || !mTasks.empty(); });
+                    if (mTasks.empty()) return;
+                    task = std::move(mTasks.front());
+                    mTasks.pop();
+                }
+                task();
+            }
+        }
+
+        std::mutex mMutex;
+        std::condition_variable mWakeup;
+        std::queue<std::packaged_task<void()>> mTasks;
+        bool mDone = false;
+        std::vector<std::thread> mThreads;
+};
+
+float work(float x) {
+    for (int i = 0; i < 1024; ++i) x = x * 0.5f + 1.0f;
+    return x;
+}
+}
+
+// Only the submission is timed, as in Pool_SubmitEach.
+BENCHMARK(Baseline_Async_SubmitEach, FANOUT) {
+    std::vector<std::future<void>> futures;
+    futures.reserve(arg);
+    auto elapsed = time([&] () -> void {
+        for (size_t i = 0; i < arg; ++i) {
+            futures.push_back(std::async(std::launch::async, [] () -> void {}));
+        }
+    });
+    for (auto& f : futures) f.wait();
+    return {arg, elapsed};
+}
+
+BENCHMARK(Baseline_NaivePool_SubmitEach, FANOUT) {
+    NaivePool pool;
+    std::vector<std::future<void>> futures;
+    futures.reserve(arg);
+    auto elapsed = time([&] () -> void {
+        for (size_t i = 0; i < arg; ++i) futures.push_back(pool.schedule([] () -> void {}));
+    });
+    for (auto& f : futures) f.wait();
+    return {arg, elapsed};
+}
+
+// As Pool_Producers.
+BENCHMARK(Baseline_NaivePool_Producers, PRODUCERS) {
+    NaivePool pool;
+    size_t share = TASKS / arg;
+    auto elapsed = time([&] () -> void {
+        std::vector<std::thread> producers;
+        for (size_t i = 0; i < arg; ++i) {
+            producers.emplace_back([&pool, share] () -> void {
+                std::vector<std::future<void>> futures;
+                futures.reserve(share);
+                for (size_t j = 0; j < share; ++j) futures.push_back(pool.schedule([] () -> void {}));
+                for (auto& f : futures) f.wait();
+            });
+        }
+        for (auto& p : producers) p.join();
+    });
+    return {share * arg, elapsed};
+}
+
+BENCHMARK(Baseline_Async_RoundTrip, ROUNDTRIPS) {
+    auto elapsed = time([&] () -> void {
+        for (size_t i = 0; i < arg; ++i) std::async(std::launch::async, [] () -> void {}).wait();
+    });
+    return {arg, elapsed};
+}
+
+BENCHMARK(Baseline_NaivePool_RoundTrip, ROUNDTRIPS) {
+    NaivePool pool(1);
+    pool.schedule([] () -> void {}).wait();
+    auto elapsed = time([&] () -> void {
+        for (size_t i = 0; i < arg; ++i) pool.schedule([] () -> void {}).wait();
+    });
+    return {arg, elapsed};
+}
+
+// As Beehive_ForEach_Workers: one task per element.
+BENCHMARK(Baseline_NaivePool_ForEach_Workers, processors()) {
+    NaivePool pool(arg);
+    std::vector<float> v(SCALING, 1.0f);
+    auto elapsed = time([&] () -> void {
+        std::vector<std::future<void>> futures;
+        futures.reserve(v.size());
+        for (auto& x : v) futures.push_back(pool.schedule([&x] () -> void { x = work(x); }));
+        for (auto& f : futures) f.wait();
+    });
+    return {SCALING, elapsed};
+}
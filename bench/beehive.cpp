@@ -0,0 +1,76 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench.h"
+#include <beehive/beehive.h>
+#include <vector>
+
+using namespace beehive;
+using namespace beehive::bench;
+
+namespace {
+const std::vector<size_t> ELEMENTS = {10000, 100000, 1000000};
+// Each element is a task, with about a microsecond of work.
+constexpr size_t SCALING = 1 << 16;
+
+float work(float x) {
+    for (int i = 0; i < 1024; ++i) x = x * 0.5f + 1.0f;
+    return x;
+}
+}
+
+BENCHMARK(Beehive_ForEach, ELEMENTS) {
+    Beehive beehive;
+    std::vector<float> v(arg, 1.0f);
+    auto elapsed = time([&] () -> void {
+        beehive.foreach(v.begin(), v.end(), [] (float x) -> float {
+            return x * 2.0f + 1.0f;
+        });
+    });
+    return {arg, elapsed};
+}
+
+BENCHMARK(Beehive_ParallelFor, ELEMENTS) {
+    Beehive beehive;
+    std::vector<float> v(arg, 1.0f);
+    float* data = v.data();
+    auto elapsed = time([&] () -> void {
+        beehive.parallel_for(size_t(0), arg, [data] (size_t first, size_t last) -> void {
+            for (size_t i = first; i < last; ++i) data[i] = data[i] * 2.0f + 1.0f;
+        });
+    });
+    return {arg, elapsed};
+}
+
+// The same work over a growing number of workers.
+BENCHMARK(Beehive_ForEach_Workers, processors()) {
+    Beehive beehive(arg);
+    std::vector<float> v(SCALING, 1.0f);
+    auto elapsed = time([&] () -> void {
+        beehive.foreach(v.begin(), v.end(), work);
+    });
+    return {SCALING, elapsed};
+}
+
+BENCHMARK(Beehive_Transform_Workers, processors()) {
+    Beehive beehive(arg);
+    std::vector<float> in(SCALING, 1.0f);
+    std::vector<float> out(SCALING);
+    auto elapsed = time([&] () -> void {
+        beehive.transform(in.begin(), in.end(), work, out.begin());
+    });
+    return {SCALING, elapsed};
+}
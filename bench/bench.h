@@ -0,0 +1,65 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace beehive {
+namespace bench {
+// What one run of a benchmark did, and how long it took doing it.
+struct Measurement {
+    uint64_t items;
+    std::chrono::nanoseconds elapsed;
+};
+
+// A benchmark is run once per argument, a few times over, and the median
+// run is reported.
+using Function = std::function<Measurement(size_t)>;
+
+bool add(const char* name, std::vector<size_t> args, Function f);
+
+// Powers of two up to the number of processors, and that number, to plot
+// how things scale.
+inline std::vector<size_t> processors() {
+    size_t n = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> p;
+    for (size_t i = 1; i < n; i *= 2) p.push_back(i);
+    p.push_back(n);
+    return p;
+}
+
+template<typename F>
+std::chrono::nanoseconds time(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::steady_clock::now() - start;
+}
+}
+}
+
+#define BENCH_CONCAT2(a, b) a ## b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+
+#define BENCHMARK(NAME, ...) \
+    static beehive::bench::Measurement NAME(size_t); \
+    static bool BENCH_CONCAT(NAME, _registered) = beehive::bench::add(#NAME, __VA_ARGS__, NAME); \
+    static beehive::bench::Measurement NAME(size_t arg)
@@ -0,0 +1,97 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+
+using namespace beehive::bench;
+
+namespace {
+struct Benchmark {
+    const char* name;
+    std::vector<size_t> args;
+    Function f;
+};
+
+std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> gBenchmarks;
+    return gBenchmarks;
+}
+}
+
+bool beehive::bench::add(const char* name, std::vector<size_t> args, Function f) {
+    registry().push_back({name, args, f});
+    return true;
+}
+
+// Usage: bench [--reps N] [filter...]
+// Only benchmarks whose name contains one of the filters are run.
+int main(int argc, char** argv) {
+    size_t reps = 3;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "--reps") && i + 1 < argc) {
+            reps = std::max(1, atoi(argv[++i]));
+        } else {
+            filters.push_back(argv[i]);
+        }
+    }
+
+    auto& benchmarks = registry();
+    std::sort(benchmarks.begin(), benchmarks.end(), [] (const auto& a, const auto& b) -> bool {
+        return strcmp(a.name, b.name) < 0;
+    });
+
+    std::cout << std::left << std::setw(48) << "benchmark"
+              << std::right << std::setw(16) << "time (us)"
+              << std::setw(16) << "ns/item"
+              << std::setw(16) << "items/s" << std::endl;
+
+    for (const auto& b : benchmarks) {
+        if (!filters.empty()) {
+            auto match = std::any_of(filters.begin(), filters.end(), [&b] (const auto& f) -> bool {
+                return std::string(b.name).find(f) != std::string::npos;
+            });
+            if (!match) continue;
+        }
+        for (auto arg : b.args) {
+            std::vector<Measurement> runs;
+            for (size_t i = 0; i < reps; ++i) runs.push_back(b.f(arg));
+            std::sort(runs.begin(), runs.end(), [] (const auto& x, const auto& y) -> bool {
+                return x.elapsed < y.elapsed;
+            });
+            auto m = runs[runs.size() / 2];
+            double ns = m.elapsed.count();
+            double items = m.items ? m.items : 1;
+
+            std::stringstream ss;
+            ss << b.name << "/" << arg;
+            std::cout << std::left << std::setw(48) << ss.str()
+                      << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(16) << ns / 1000.0
+                      << std::setw(16) << ns / items
+                      << std::setw(16) << std::setprecision(0) << items * 1e9 / ns
+                      << std::endl;
+        }
+    }
+    return 0;
+}
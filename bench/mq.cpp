@@ -0,0 +1,58 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench.h"
+#include <beehive/mq.h>
+#include <thread>
+#include <vector>
+
+using namespace beehive;
+using namespace beehive::bench;
+
+namespace {
+constexpr size_t MESSAGES = 1 << 20;
+const std::vector<size_t> PRODUCERS = {1, 2, 4, 8, 16, 32, 64};
+
+// Each producer sends its share of MESSAGES, one consumer drains them all.
+template<typename Queue>
+Measurement producers(size_t n) {
+    Queue q;
+    size_t share = MESSAGES / n;
+    auto elapsed = time([&] () -> void {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n; ++i) {
+            threads.emplace_back([&q, share] () -> void {
+                for (size_t j = 0; j < share; ++j) q.send(j);
+            });
+        }
+        size_t received = 0;
+        while (received < share * n) {
+            if (q.receive()) ++received;
+            else std::this_thread::yield();
+        }
+        for (auto& t : threads) t.join();
+    });
+    return {share * n, elapsed};
+}
+}
+
+BENCHMARK(MessageQueue_Producers, PRODUCERS) {
+    return producers<MessageQueue<size_t>>(arg);
+}
+
+BENCHMARK(RingMessageQueue_Producers, PRODUCERS) {
+    return producers<RingMessageQueue<size_t>>(arg);
+}
@@ -0,0 +1,99 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench.h"
+#include <beehive/pool.h>
+#include <thread>
+#include <vector>
+
+using namespace beehive;
+using namespace beehive::bench;
+
+namespace {
+const std::vector<size_t> FANOUT = {1000, 10000, 100000};
+const std::vector<size_t> PRODUCERS = {1, 2, 4, 8};
+const std::vector<size_t> ROUNDTRIPS = {1000, 10000};
+constexpr size_t TASKS = 100000;
+
+// Schedules one empty task at a time, and waits for it.
+Measurement roundtrips(Pool& pool, size_t n) {
+    pool.schedule([] () -> void {}).wait();
+    auto elapsed = time([&] () -> void {
+        for (size_t i = 0; i < n; ++i) pool.schedule([] () -> void {}).wait();
+    });
+    return {n, elapsed};
+}
+}
+
+// Only the submission is timed, waiting for the tasks to run is not.
+BENCHMARK(Pool_SubmitEach, FANOUT) {
+    Pool pool;
+    std::vector<std::shared_future<void>> futures;
+    futures.reserve(arg);
+    auto elapsed = time([&] () -> void {
+        for (size_t i = 0; i < arg; ++i) {
+            futures.push_back(pool.schedule([] () -> void {}));
+        }
+    });
+    for (auto& f : futures) f.wait();
+    return {arg, elapsed};
+}
+
+BENCHMARK(Pool_SubmitBatch, FANOUT) {
+    Pool pool;
+    std::vector<Task::Callable> tasks;
+    tasks.reserve(arg);
+    for (size_t i = 0; i < arg; ++i) tasks.emplace_back([] () -> void {});
+    std::vector<std::shared_future<void>> futures;
+    auto elapsed = time([&] () -> void {
+        futures = pool.scheduleBatch(std::move(tasks));
+    });
+    for (auto& f : futures) f.wait();
+    return {arg, elapsed};
+}
+
+// Producers each schedule their share of TASKS, until all of them ran.
+BENCHMARK(Pool_Producers, PRODUCERS) {
+    Pool pool;
+    size_t share = TASKS / arg;
+    auto elapsed = time([&] () -> void {
+        std::vector<std::thread> producers;
+        for (size_t i = 0; i < arg; ++i) {
+            producers.emplace_back([&pool, share] () -> void {
+                std::vector<std::shared_future<void>> futures;
+                futures.reserve(share);
+                for (size_t j = 0; j < share; ++j) futures.push_back(pool.schedule([] () -> void {}));
+                for (auto& f : futures) f.wait();
+            });
+        }
+        for (auto& p : producers) p.join();
+    });
+    return {share * arg, elapsed};
+}
+
+// The worker goes to sleep between tasks.
+BENCHMARK(Pool_RoundTrip_Sleeping, ROUNDTRIPS) {
+    Pool pool(1);
+    return roundtrips(pool, arg);
+}
+
+// The worker polls for the next task, and is still awake when it comes.
+BENCHMARK(Pool_RoundTrip_Spinning, ROUNDTRIPS) {
+    Pool::Options opts;
+    opts.spin = std::chrono::microseconds(200);
+    Pool pool(1, opts);
+    return roundtrips(pool, arg);
+}
@@ -0,0 +1,86 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench.h"
+#include <beehive/pq.h>
+#include <beehive/task.h>
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+using namespace beehive;
+using namespace beehive::bench;
+
+namespace {
+constexpr size_t OPERATIONS = 1 << 20;
+// How many tasks are queued at once.
+const std::vector<size_t> DEPTH = {16, 1024, 65536};
+
+// Keeps depth values queued, and pops one for every one pushed, with
+// priorities spread over a handful of levels as real workloads do.
+template<typename Queue>
+Measurement churn(size_t depth) {
+    Queue q;
+    auto value = std::make_shared<int>(0);
+    uint32_t x = 2463534242u;
+    auto level = [&x] () -> uint8_t {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return Task::DefaultPriority + x % 8;
+    };
+    for (size_t i = 0; i < depth; ++i) q.push(level(), value);
+    auto elapsed = time([&] () -> void {
+        for (size_t i = 0; i < OPERATIONS; ++i) {
+            q.push(level(), value);
+            q.trypop();
+        }
+    });
+    return {OPERATIONS, elapsed};
+}
+
+// Pushes depth values, then pops them all, a few times over.
+template<typename Queue>
+Measurement fill(size_t depth) {
+    Queue q;
+    auto value = std::make_shared<int>(0);
+    size_t rounds = std::max<size_t>(1, OPERATIONS / depth);
+    auto elapsed = time([&] () -> void {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < depth; ++i) q.push(Task::Priority(i * 37), value);
+            while (q.trypop()) {}
+        }
+    });
+    return {rounds * depth, elapsed};
+}
+}
+
+BENCHMARK(PriorityQueue_Churn, DEPTH) {
+    return churn<PriorityQueue<Task::Priority, std::shared_ptr<int>>>(arg);
+}
+
+BENCHMARK(BucketQueue_Churn, DEPTH) {
+    return churn<BucketQueue<std::shared_ptr<int>>>(arg);
+}
+
+BENCHMARK(PriorityQueue_PushPop, DEPTH) {
+    return fill<PriorityQueue<Task::Priority, std::shared_ptr<int>>>(arg);
+}
+
+BENCHMARK(BucketQueue_PushPop, DEPTH) {
+    return fill<BucketQueue<std::shared_ptr<int>>>(arg);
+}
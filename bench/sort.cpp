@@ -0,0 +1,70 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench.h"
+#include <beehive/beehive.h>
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+using namespace beehive;
+using namespace beehive::bench;
+
+namespace {
+const std::vector<size_t> ELEMENTS = {1000000, 10000000, 100000000};
+
+std::vector<uint64_t> shuffled(size_t n) {
+    std::vector<uint64_t> v(n);
+    uint64_t x = 88172645463325252ull;
+    for (auto& e : v) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        e = x;
+    }
+    return v;
+}
+}
+
+BENCHMARK(Sort_Std, ELEMENTS) {
+    auto v = shuffled(arg);
+    auto elapsed = time([&] () -> void {
+        std::sort(v.begin(), v.end());
+    });
+    return {arg, elapsed};
+}
+
+BENCHMARK(Sort_Beehive, ELEMENTS) {
+    Beehive beehive;
+    auto v = shuffled(arg);
+    auto elapsed = time([&] () -> void {
+        beehive.sort(v.begin(), v.end());
+    });
+    return {arg, elapsed};
+}
+
+BENCHMARK(Merge_Beehive, ELEMENTS) {
+    Beehive beehive;
+    auto v = shuffled(arg);
+    auto mid = v.begin() + arg / 2;
+    std::sort(v.begin(), mid);
+    std::sort(mid, v.end());
+    std::vector<uint64_t> out(arg);
+    auto elapsed = time([&] () -> void {
+        beehive.merge(v.begin(), mid, mid, v.end(), out.begin());
+    });
+    return {arg, elapsed};
+}
@@ -0,0 +1,70 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <beehive/pool.h>
+
+namespace beehive {
+// Grows and shrinks a Pool between bounds, from a thread of its own. Every
+// interval it looks at how busy the workers were since the last look, per
+// their active and idle time, and at how many tasks are queued. It grows
+// the pool by half when tasks are waiting and the workers were busy, and
+// retires one worker at a time when nothing is waiting and they were not.
+class Autoscaler {
+    public:
+        struct Options {
+            size_t min = 1;
+            // 0 stands for the number of processors.
+            size_t max = 0;
+            std::chrono::milliseconds interval{100};
+            // Fractions of time the workers spent active.
+            double grow = 0.75;
+            double shrink = 0.25;
+        };
+
+        Autoscaler(Pool*, const Options&);
+        ~Autoscaler();
+
+        Autoscaler(const Autoscaler&) = delete;
+        Autoscaler& operator=(const Autoscaler&) = delete;
+
+        // Samples the pool and resizes it once. Returns the change in size.
+        // Safe to call alongside the scaler's own thread.
+        int step();
+
+    private:
+        void loop();
+
+        Pool* mPool;
+        Options mOptions;
+        // Guards the samples below, across a whole step.
+        std::mutex mStepMutex;
+        std::chrono::nanoseconds mActive{0};
+        std::chrono::nanoseconds mIdle{0};
+        size_t mSize = 0;
+
+        std::mutex mMutex;
+        std::condition_variable mWakeup;
+        bool mStopped = false;
+        std::thread mThread;
+};
+}
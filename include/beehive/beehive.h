@@ -16,11 +16,23 @@ limitations under the License.
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <functional>
 #include <future>
+#include <beehive/coroutine.h>
+#include <beehive/future.h>
+#include <beehive/platform.h>
 #include <beehive/pool.h>
+#include <beehive/recycler.h>
+#include <condition_variable>
+#include <deque>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <type_traits>
 #include <vector>
 
@@ -28,32 +40,252 @@ namespace beehive {
 class Beehive {
     public:
         Beehive(size_t n = 0) : mPool(n) {}
+        Beehive(size_t n, const Pool::Options& o) : mPool(n, o) {}
         ~Beehive() = default;
 
+        // The callable and its arguments are decayed and moved into the task,
+        // as with std::async, and the task runs them exactly once.
         template<class Callable, class... Args>
-        std::shared_future<std::result_of_t<Callable(Args...)>> schedule(Callable f, Args... args) {
-            using R = std::result_of_t<Callable(Args...)>;
-            using Promise = std::promise<R>;
-            using Future = std::shared_future<R>;
-            auto flower = std::make_shared<Promise>();
-            Future pollen = Future(flower->get_future());
-            auto task = [args = std::make_tuple(std::forward<Args>(args) ...), f, flower] ()mutable -> void {
-                if constexpr (std::is_same_v<R, void>) {
-                    std::apply(f,args);
-                    flower->set_value();
-                } else {
-                    auto result = std::apply(f, args);
-                    flower->set_value(result);
+        auto schedule(Callable&& f, Args&&... args) {
+            auto [task, pollen] = package(std::forward<Callable>(f), std::forward<Args>(args)...);
+            mPool.post(std::move(task));
+            return pollen;
+        }
+
+        // Schedules every callable in the range as one batch. The callables
+        // are moved out of the range, so that move-only ones can be used.
+        template<typename Iter>
+        auto scheduleAll(Iter from, Iter to, Task::Priority p = Task::DefaultPriority) {
+            using R = Result<typename std::iterator_traits<Iter>::reference>;
+            std::vector<Task::Callable> tasks;
+            std::vector<Future<R>> futures;
+            for (; from != to; ++from) {
+                auto [task, pollen] = package(std::move(*from));
+                tasks.emplace_back(std::move(task));
+                futures.emplace_back(std::move(pollen));
+            }
+            mPool.scheduleBatch(std::move(tasks), p);
+            return futures;
+        }
+
+        // co_await beehive.schedule_on() resumes the coroutine on a worker.
+        Pool::Resume schedule_on(Task::Priority p = Task::DefaultPriority) {
+            return mPool.schedule_on(p);
+        }
+
+        // Futures that become ready once all, or any, of the futures in
+        // [from, to) are. Use then() on them to schedule dependent work.
+        template<typename Iter>
+        auto when_all(Iter from, Iter to) {
+            return beehive::when_all(&mPool, from, to);
+        }
+
+        template<typename Iter>
+        auto when_any(Iter from, Iter to) {
+            return beehive::when_any(&mPool, from, to);
+        }
+
+        // Calls body(first, last) on contiguous sub-ranges of [begin, end),
+        // which can be random-access iterators or plain indices. Unless a
+        // grain is given, chunk sizes adapt so that each chunk runs for about
+        // ChunkTime. Chunks are claimed in order from a shared cursor by one
+        // task per worker and by the calling thread, which rethrows the first
+        // exception thrown by body, if any.
+        template<typename Iter, typename Body>
+        void parallel_for(Iter begin, Iter end, Body body, size_t grain = 0) {
+            if (!(begin < end)) return;
+            size_t n = end - begin;
+            auto state = std::make_shared<ForState<Body>>(std::move(body), n, grain);
+            auto done = state->done.get_future();
+
+            size_t helpers = std::min(n, mPool.size());
+            std::vector<Task::Callable> tasks;
+            for (size_t i = 0; i < helpers; ++i) {
+                tasks.emplace_back([this, state, begin] () -> void {
+                    forchunks(state, begin);
+                });
+            }
+            if (!tasks.empty()) mPool.scheduleBatch(std::move(tasks));
+
+            // The caller only ever runs chunks of its own: once none are left
+            // to claim, what it waits for is already running elsewhere, even
+            // if the caller is itself a worker and its siblings are all busy.
+            forchunks(state, begin);
+            done.wait();
+            if (state->error) std::rethrow_exception(state->error);
+        }
+
+        enum class Reduction {
+            // Partials are kept per worker, and the grouping of operations
+            // depends on timing. op must be associative and commutative.
+            FAST,
+            // The range is cut into chunks that only depend on its length,
+            // and partials are combined in a fixed order, so that the result
+            // is the same from run to run, whatever the number of workers.
+            // op must be associative.
+            DETERMINISTIC,
+        };
+
+        // Parallel counterpart of std::transform_reduce: combines init and
+        // transform(x) for every x in [first, last) using op.
+        template<typename Iter, typename T, typename Op, typename Transform>
+        T transform_reduce(Iter first, Iter last, T init, Op op, Transform transform,
+                           Reduction mode = Reduction::FAST) {
+            if (!(first < last)) return init;
+            auto chunk = [&op, &transform] (Iter from, Iter to) -> T {
+                T acc = transform(*from);
+                for (++from; from != to; ++from) acc = op(std::move(acc), transform(*from));
+                return acc;
+            };
+
+            std::vector<T> partials;
+            if (mode == Reduction::DETERMINISTIC) {
+                size_t n = last - first;
+                size_t chunks = std::min(n, DeterministicChunks);
+                std::vector<std::optional<T>> slots(chunks);
+                parallel_for(size_t(0), chunks, [&] (size_t from, size_t to) -> void {
+                    for (size_t i = from; i < to; ++i) {
+                        slots[i].emplace(chunk(first + i * n / chunks, first + (i + 1) * n / chunks));
+                    }
+                }, 1);
+                for (auto& v : slots) partials.push_back(std::move(*v));
+            } else {
+                // One slot per worker, plus one for the caller and any worker
+                // added after we started.
+                struct alignas(Platform::CacheLine) Slot {
+                    std::mutex mutex;
+                    std::optional<T> value;
+                };
+                size_t n = mPool.size();
+                std::vector<Slot> slots(n + 1);
+                parallel_for(first, last, [&] (Iter from, Iter to) -> void {
+                    T acc = chunk(from, to);
+                    auto wk = Worker::current();
+                    size_t i = (wk && wk->pool() == &mPool) ? std::min<size_t>(wk->id(), n) : n;
+                    std::unique_lock<std::mutex> lk(slots[i].mutex);
+                    if (slots[i].value) {
+                        slots[i].value.emplace(op(std::move(*slots[i].value), std::move(acc)));
+                    } else {
+                        slots[i].value.emplace(std::move(acc));
+                    }
+                });
+                for (auto& s : slots) {
+                    if (s.value) partials.push_back(std::move(*s.value));
+                }
+            }
+
+            // Combine neighbours pairwise, as a balanced tree.
+            for (size_t width = 1; width < partials.size(); width *= 2) {
+                for (size_t i = 0; i + width < partials.size(); i += 2 * width) {
+                    partials[i] = op(std::move(partials[i]), std::move(partials[i + width]));
                 }
+            }
+            return op(std::move(init), std::move(partials[0]));
+        }
+
+        template<typename Iter, typename T, typename Op>
+        T reduce(Iter first, Iter last, T init, Op op, Reduction mode = Reduction::FAST) {
+            return transform_reduce(first, last, std::move(init), op, [] (const auto& x) -> T {
+                return x;
+            }, mode);
+        }
+
+        // Parallel counterpart of std::merge, for random-access iterators.
+        // The output is cut into pieces at points found by binary search, and
+        // the pieces are merged independently. Like std::merge, this is
+        // stable: equal elements from the first range come first.
+        template<typename Iter1, typename Iter2, typename OutIter, typename Compare = std::less<>>
+        OutIter merge(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, OutIter dest,
+                      Compare comp = Compare()) {
+            size_t n1 = last1 - first1;
+            size_t n2 = last2 - first2;
+            size_t total = n1 + n2;
+            size_t pieces = std::min(total / SortCutoff, 4 * (mPool.size() + 1));
+            if (pieces < 2) return std::merge(first1, last1, first2, last2, dest, comp);
+
+            // How many of the first d outputs come from the first range.
+            auto split = [&] (size_t d) -> size_t {
+                size_t lo = d > n2 ? d - n2 : 0;
+                size_t hi = std::min(d, n1);
+                while (lo < hi) {
+                    size_t i = lo + (hi - lo) / 2;
+                    size_t j = d - i;
+                    if (j > 0 && !comp(first2[j - 1], first1[i])) lo = i + 1;
+                    else hi = i;
+                }
+                return lo;
             };
-            mPool.schedule(task);
-            return pollen;
+            // All the split points are found before any piece starts: with
+            // move iterators, merging a piece empties elements that searches
+            // for its neighbours would otherwise read.
+            std::vector<size_t> splits(pieces + 1);
+            for (size_t k = 0; k <= pieces; ++k) splits[k] = split(k * total / pieces);
+            parallel_for(size_t(0), pieces, [&] (size_t from, size_t to) -> void {
+                for (size_t k = from; k < to; ++k) {
+                    size_t d0 = k * total / pieces, d1 = (k + 1) * total / pieces;
+                    size_t i0 = splits[k], i1 = splits[k + 1];
+                    std::merge(first1 + i0, first1 + i1, first2 + (d0 - i0), first2 + (d1 - i1),
+                               dest + d0, comp);
+                }
+            }, 1);
+            return dest + total;
+        }
+
+        // Parallel counterpart of std::sort: sorts one chunk per worker, then
+        // merges neighbouring runs in rounds using merge above. Ranges shorter
+        // than SortCutoff are handed to std::sort. Elements must be default
+        // constructible and movable.
+        template<typename Iter, typename Compare = std::less<>>
+        void sort(Iter first, Iter last, Compare comp = Compare()) {
+            size_t n = last - first;
+            size_t chunks = std::min(n / SortCutoff, mPool.size() + 1);
+            if (chunks < 2) {
+                std::sort(first, last, comp);
+                return;
+            }
+
+            std::vector<size_t> bounds;
+            for (size_t i = 0; i <= chunks; ++i) bounds.push_back(i * n / chunks);
+            parallel_for(size_t(0), chunks, [&] (size_t from, size_t to) -> void {
+                for (size_t k = from; k < to; ++k) {
+                    std::sort(first + bounds[k], first + bounds[k + 1], comp);
+                }
+            }, 1);
+
+            // Each round halves the number of runs, moving them back and
+            // forth between the input and a scratch buffer.
+            std::vector<typename std::iterator_traits<Iter>::value_type> scratch(n);
+            auto round = [&] (auto src, auto dst) -> void {
+                size_t runs = bounds.size() - 1;
+                for (size_t k = 0; k + 1 < runs; k += 2) {
+                    merge(std::make_move_iterator(src + bounds[k]), std::make_move_iterator(src + bounds[k + 1]),
+                          std::make_move_iterator(src + bounds[k + 1]), std::make_move_iterator(src + bounds[k + 2]),
+                          dst + bounds[k], comp);
+                }
+                if (runs % 2) std::move(src + bounds[runs - 1], src + n, dst + bounds[runs - 1]);
+                std::vector<size_t> merged;
+                for (size_t k = 0; k < runs; k += 2) merged.push_back(bounds[k]);
+                merged.push_back(n);
+                bounds.swap(merged);
+            };
+            bool inScratch = false;
+            while (bounds.size() > 2) {
+                if (inScratch) round(scratch.begin(), first);
+                else round(first, scratch.begin());
+                inScratch = !inScratch;
+            }
+            if (inScratch) {
+                auto from = scratch.begin();
+                parallel_for(size_t(0), n, [from, first] (size_t lo, size_t hi) -> void {
+                    std::move(from + lo, from + hi, first + lo);
+                });
+            }
         }
 
         template<typename InIter, typename Callable>
         void foreach(InIter from, InIter to, Callable f) {
             using In = typename std::iterator_traits<InIter>::value_type;
-            using R = std::result_of_t<Callable(In)>;
+            using R = std::invoke_result_t<Callable&, In>;
             using Future = std::shared_future<R>;
             std::vector<Future> futures;
             for (; from != to; ++from) {
@@ -64,36 +296,141 @@ class Beehive {
             }
         }
 
+        // Applies f to every input, writing the results to dest in input
+        // order. The input is read as it goes, and at most window elements are
+        // in flight at any time (twice the number of workers by default).
         template<typename InIter, typename Callable, typename OutIter>
-        void transform(InIter from, InIter to, Callable f, OutIter dest) {
+        void transform(InIter from, InIter to, Callable f, OutIter dest, size_t window = 0) {
             using In = typename std::iterator_traits<InIter>::value_type;
-            using R = std::result_of_t<Callable(In)>;
-            using Future = std::shared_future<R>;
-            using Type = std::pair<bool, Future>;
-            std::vector<Type> futures;
+            using R = Result<Callable&, In>;
+            if (window == 0) window = 2 * mPool.size();
+            std::deque<std::shared_future<R>> inflight;
             for (; from != to; ++from) {
-                futures.push_back({false, schedule(f, *from)});
+                if (inflight.size() >= window) {
+                    *dest++ = inflight.front().get();
+                    inflight.pop_front();
+                }
+                inflight.push_back(schedule(f, *from));
             }
-            bool more = true;
-            while(more) {
-                more = false;
-                for (auto& f : futures) {
-                    if (f.first) continue;
-                    more = true;
-                    auto ready = f.second.wait_for(std::chrono::seconds(0));
-                    if (ready == std::future_status::ready) {
-                        f.first = true;
-                        *dest++ = f.second.get();
+            for (; !inflight.empty(); inflight.pop_front()) {
+                *dest++ = inflight.front().get();
+            }
+        }
+
+        // As transform, except that sink(result) is called, on the calling
+        // thread, as soon as each result is ready.
+        template<typename InIter, typename Callable, typename Sink>
+        void transform_unordered(InIter from, InIter to, Callable f, Sink sink, size_t window = 0) {
+            using In = typename std::iterator_traits<InIter>::value_type;
+            using R = Result<Callable&, In>;
+            struct Completions {
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::deque<std::pair<std::optional<R>, std::exception_ptr>> done;
+            };
+            if (window == 0) window = 2 * mPool.size();
+            auto c = std::make_shared<Completions>();
+            size_t inflight = 0;
+            auto collect = [&c, &inflight, &sink] () -> void {
+                std::unique_lock<std::mutex> lk(c->mutex);
+                c->cv.wait(lk, [&c] () -> bool { return !c->done.empty(); });
+                auto outcome = std::move(c->done.front());
+                c->done.pop_front();
+                lk.unlock();
+                --inflight;
+                if (outcome.second) std::rethrow_exception(outcome.second);
+                sink(std::move(*outcome.first));
+            };
+            for (; from != to; ++from) {
+                if (inflight >= window) collect();
+                ++inflight;
+                mPool.post([c, f, in = In(*from)] () mutable -> void {
+                    std::pair<std::optional<R>, std::exception_ptr> outcome;
+                    try {
+                        outcome.first.emplace(f(std::move(in)));
+                    } catch (...) {
+                        outcome.second = std::current_exception();
                     }
-                }
+                    {
+                        std::unique_lock<std::mutex> lk(c->mutex);
+                        c->done.push_back(std::move(outcome));
+                    }
+                    c->cv.notify_one();
+                });
             }
+            while (inflight > 0) collect();
         }
 
         Pool* operator->() {
             return &mPool;
         }
 
+        // What parallel_for aims for when adapting its chunk size.
+        static constexpr std::chrono::microseconds ChunkTime{50};
+        // How many pieces a DETERMINISTIC reduction cuts its range into.
+        static constexpr size_t DeterministicChunks = 1024;
+        // Below this many elements, sort and merge stay on the calling thread.
+        static constexpr size_t SortCutoff = 1 << 15;
+
     private:
+        template<typename Body>
+        struct ForState {
+            ForState(Body b, size_t n, size_t g) : body(std::move(b)), size(n), remaining(n),
+                                                   grain(g ? g : 1), adaptive(g == 0) {}
+
+            Body body;
+            const size_t size;
+            // The start of the next chunk to claim.
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> remaining;
+            std::atomic<size_t> grain;
+            const bool adaptive;
+            std::atomic<bool> failed{false};
+            std::exception_ptr error;
+            std::promise<void> done;
+        };
+
+        // Runs chunks until there are none left to claim.
+        template<typename State, typename Iter>
+        void forchunks(const std::shared_ptr<State>& state, Iter begin) {
+            while (true) {
+                size_t g = state->grain.load(std::memory_order_relaxed);
+                size_t first = state->next.fetch_add(g, std::memory_order_relaxed);
+                if (first >= state->size) return;
+                size_t k = std::min(g, state->size - first);
+                if (!state->failed.load(std::memory_order_relaxed)) {
+                    auto start = std::chrono::steady_clock::now();
+                    try {
+                        state->body(begin + first, begin + (first + k));
+                    } catch (...) {
+                        if (!state->failed.exchange(true)) state->error = std::current_exception();
+                    }
+                    if (state->adaptive) {
+                        auto elapsed = std::chrono::steady_clock::now() - start;
+                        auto ns = std::max<int64_t>(1, std::chrono::nanoseconds(elapsed).count());
+                        auto target = std::chrono::nanoseconds(ChunkTime).count();
+                        auto want = std::max<size_t>(1, k * target / ns);
+                        state->grain.store((g + want + 1) / 2, std::memory_order_relaxed);
+                    }
+                }
+                if (state->remaining.fetch_sub(k) == k) state->done.set_value();
+            }
+        }
+
+        template<class Callable, class... Args>
+        using Result = decltype(std::apply(std::declval<std::decay_t<Callable>>(),
+                                           std::declval<decltype(std::make_tuple(std::declval<Args>()...))>()));
+
+        // Wraps a call into a task that fulfills the returned future.
+        template<class Callable, class... Args>
+        auto package(Callable&& f, Args&&... args) {
+            using R = Result<Callable, Args...>;
+            return beehive::package(&mPool, [args = std::make_tuple(std::forward<Args>(args) ...),
+                                             f = std::forward<Callable>(f)] () mutable -> R {
+                return std::apply(std::move(f), std::move(args));
+            });
+        }
+
         Pool mPool;
 };
 }
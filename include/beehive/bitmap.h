@@ -0,0 +1,101 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace beehive {
+// A fixed-size set of bits that can be set, cleared and claimed from any
+// thread without locks.
+template<size_t Bits>
+class AtomicBitmap {
+    public:
+        static constexpr size_t Words = (Bits + 63) / 64;
+        // Selects the bits claim may pick from.
+        using Mask = std::array<uint64_t, Words>;
+
+        AtomicBitmap() = default;
+
+        AtomicBitmap(const AtomicBitmap&) = delete;
+        AtomicBitmap& operator=(const AtomicBitmap&) = delete;
+
+        void set(size_t i) {
+            mWords[i / 64].fetch_or(bit(i));
+        }
+
+        // Returns whether this call is the one that cleared the bit.
+        bool clear(size_t i) {
+            return mWords[i / 64].fetch_and(~bit(i)) & bit(i);
+        }
+
+        bool test(size_t i) const {
+            return mWords[i / 64].load() & bit(i);
+        }
+
+        // Clears the lowest set bit, and returns its index.
+        std::optional<size_t> claim() {
+            for (size_t w = 0; w < Words; ++w) {
+                auto v = mWords[w].load();
+                while (v) {
+                    auto b = __builtin_ctzll(v);
+                    if (mWords[w].compare_exchange_weak(v, v & ~(uint64_t(1) << b))) {
+                        return w * 64 + b;
+                    }
+                }
+            }
+            return std::nullopt;
+        }
+
+        // As claim, among the bits also set in the mask.
+        std::optional<size_t> claim(const Mask& mask) {
+            for (size_t w = 0; w < Words; ++w) {
+                auto v = mWords[w].load();
+                while (v & mask[w]) {
+                    auto b = __builtin_ctzll(v & mask[w]);
+                    if (mWords[w].compare_exchange_weak(v, v & ~(uint64_t(1) << b))) {
+                        return w * 64 + b;
+                    }
+                }
+            }
+            return std::nullopt;
+        }
+
+        size_t count() const {
+            size_t n = 0;
+            for (const auto& w : mWords) n += __builtin_popcountll(w.load());
+            return n;
+        }
+
+        bool any() const {
+            for (const auto& w : mWords) {
+                if (w.load()) return true;
+            }
+            return false;
+        }
+
+    private:
+        static uint64_t bit(size_t i) {
+            return uint64_t(1) << (i % 64);
+        }
+
+        std::array<std::atomic<uint64_t>, Words> mWords{};
+};
+}
@@ -0,0 +1,162 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace beehive {
+template<typename T>
+class CoroutineResult {
+    public:
+        template<typename U>
+        void return_value(U&& v) {
+            mValue.emplace(std::forward<U>(v));
+        }
+
+    protected:
+        T take() {
+            return std::move(*mValue);
+        }
+
+    private:
+        std::optional<T> mValue;
+};
+
+template<>
+class CoroutineResult<void> {
+    public:
+        void return_void() {}
+
+    protected:
+        void take() {}
+};
+
+// A lazily started coroutine returning T. It runs when first awaited, on the
+// awaiting thread, and resumes its awaiter once it finishes, on whichever
+// thread it finished on. Combine with co_await pool.schedule_on() to hop
+// onto a worker, and co_await on a Future to wait for a scheduled task; in
+// either case nothing but the coroutine frame is held while suspended.
+template<typename T = void>
+class Coroutine {
+    public:
+        class promise_type : public CoroutineResult<T> {
+            public:
+                Coroutine get_return_object() {
+                    return Coroutine(Handle::from_promise(*this));
+                }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                auto final_suspend() noexcept { return Final{}; }
+                void unhandled_exception() {
+                    mError = std::current_exception();
+                }
+
+                T result() {
+                    if (mError) std::rethrow_exception(mError);
+                    return this->take();
+                }
+
+            private:
+                friend class Coroutine;
+                std::coroutine_handle<> mContinuation;
+                std::exception_ptr mError;
+        };
+
+        Coroutine(Coroutine&& c) noexcept : mHandle(std::exchange(c.mHandle, {})) {}
+        Coroutine& operator=(Coroutine&& c) noexcept {
+            if (this != &c) {
+                if (mHandle) mHandle.destroy();
+                mHandle = std::exchange(c.mHandle, {});
+            }
+            return *this;
+        }
+        ~Coroutine() {
+            if (mHandle) mHandle.destroy();
+        }
+
+        Coroutine(const Coroutine&) = delete;
+        Coroutine& operator=(const Coroutine&) = delete;
+
+        auto operator co_await() && noexcept {
+            struct Awaiter {
+                Handle handle;
+
+                bool await_ready() const noexcept { return handle.done(); }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                    handle.promise().mContinuation = awaiting;
+                    return handle;
+                }
+                T await_resume() { return handle.promise().result(); }
+            };
+            return Awaiter{mHandle};
+        }
+
+    private:
+        using Handle = std::coroutine_handle<promise_type>;
+
+        // Hands control back to the awaiter, if any, without growing the
+        // stack.
+        struct Final {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(Handle h) noexcept {
+                auto next = h.promise().mContinuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        explicit Coroutine(Handle h) : mHandle(h) {}
+
+        Handle mHandle;
+};
+
+// Runs a coroutine from regular code, blocking the calling thread until it
+// returns.
+template<typename T>
+T sync_wait(Coroutine<T> c) {
+    struct Eager {
+        struct promise_type {
+            Eager get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+    // The promise belongs to the frame, so that it outlives set_value().
+    auto run = [] (Coroutine<T> c, std::promise<T> done) -> Eager {
+        try {
+            if constexpr (std::is_same_v<T, void>) {
+                co_await std::move(c);
+                done.set_value();
+            } else {
+                done.set_value(co_await std::move(c));
+            }
+        } catch (...) {
+            done.set_exception(std::current_exception());
+        }
+    };
+    std::promise<T> done;
+    auto result = done.get_future();
+    run(std::move(c), std::move(done));
+    return result.get();
+}
+}
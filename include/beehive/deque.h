@@ -0,0 +1,131 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <beehive/pq.h>
+
+namespace beehive {
+// A double-ended queue split by priority, meant to be owned by one thread and
+// stolen from by others. The owner pushes and pops at the back (LIFO, so that
+// recently spawned work runs while still hot in cache), thieves take from the
+// front (FIFO, so that they get the oldest work). Either end always yields an
+// item of the highest priority currently stored.
+template<typename Key, typename Value, bool Order = MaxFirst>
+class StealingDeque {
+    public:
+        StealingDeque() = default;
+        ~StealingDeque() = default;
+
+        StealingDeque(const StealingDeque&) = delete;
+        StealingDeque& operator=(const StealingDeque&) = delete;
+
+        void push(Key k, Value v) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            mValues[k].push_back(std::move(v));
+            mSize.fetch_add(1);
+            updatetop();
+        }
+
+        // Pushes a whole range at the same priority, taking the lock once.
+        template<typename Iter>
+        void push(Key k, Iter begin, Iter end) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            auto& bucket = mValues[k];
+            size_t n = 0;
+            for (; begin != end; ++begin, ++n) bucket.push_back(*begin);
+            mSize.fetch_add(n);
+            updatetop();
+        }
+
+        bool empty() const {
+            return mSize.load() == 0;
+        }
+
+        size_t size() const {
+            return mSize.load();
+        }
+
+        // Returns the highest priority present, without taking the lock.
+        // This is a hint, and may be stale by the time the caller acts on it.
+        std::optional<Key> top() const {
+            if (empty()) return std::nullopt;
+            return mTop.load(std::memory_order_relaxed);
+        }
+
+        std::optional<Value> pop(Key* priority = nullptr) {
+            return take(priority, true);
+        }
+
+        std::optional<Value> steal(Key* priority = nullptr) {
+            return take(priority, false);
+        }
+
+    private:
+        using Bucket = std::deque<Value>;
+        struct Comparator {
+            bool operator()(const Key& lhs, const Key& rhs) const {
+                if constexpr (Order)
+                    return lhs > rhs;
+                else
+                    return lhs < rhs;
+            }
+        };
+        using Buckets = std::map<Key, Bucket, Comparator>;
+
+        // Empty buckets are kept around, as the same few priorities tend to be
+        // used over and over again.
+        typename Buckets::iterator first() {
+            auto i = mValues.begin();
+            while (i != mValues.end() && i->second.empty()) ++i;
+            return i;
+        }
+
+        void updatetop() {
+            auto i = first();
+            if (i != mValues.end()) mTop.store(i->first, std::memory_order_relaxed);
+        }
+
+        std::optional<Value> take(Key* priority, bool back) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            auto i = first();
+            if (i == mValues.end()) return std::nullopt;
+            std::optional<Value> v;
+            if (back) {
+                v.emplace(std::move(i->second.back()));
+                i->second.pop_back();
+            } else {
+                v.emplace(std::move(i->second.front()));
+                i->second.pop_front();
+            }
+            if (priority) *priority = i->first;
+            mSize.fetch_sub(1);
+            updatetop();
+            return v;
+        }
+
+        mutable std::mutex mValuesMutex;
+        Buckets mValues;
+        std::atomic<size_t> mSize{0};
+        std::atomic<Key> mTop{};
+};
+}
@@ -0,0 +1,148 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace beehive {
+template<typename Signature, size_t Capacity = 96>
+class UniqueFunction;
+
+// A type-erased callable, like std::function, except that it only needs the
+// target to be movable, and stores any target of up to Capacity bytes inline
+// instead of on the heap.
+template<typename R, typename... Args, size_t Capacity>
+class UniqueFunction<R(Args...), Capacity> {
+    public:
+        UniqueFunction() noexcept = default;
+        UniqueFunction(std::nullptr_t) noexcept {}
+
+        template<typename F,
+                 typename D = std::decay_t<F>,
+                 typename = std::enable_if_t<!std::is_same_v<D, UniqueFunction> &&
+                                             std::is_invocable_r_v<R, D&, Args...>>>
+        UniqueFunction(F&& f) {
+            if constexpr (fits<D>()) {
+                new (&mStorage) D(std::forward<F>(f));
+                mOps = &InlineOps<D>::ops;
+            } else {
+                new (&mStorage) D*(new D(std::forward<F>(f)));
+                mOps = &HeapOps<D>::ops;
+            }
+        }
+
+        UniqueFunction(UniqueFunction&& rhs) noexcept {
+            take(rhs);
+        }
+
+        UniqueFunction& operator=(UniqueFunction&& rhs) noexcept {
+            if (this != &rhs) {
+                reset();
+                take(rhs);
+            }
+            return *this;
+        }
+
+        UniqueFunction(const UniqueFunction&) = delete;
+        UniqueFunction& operator=(const UniqueFunction&) = delete;
+
+        ~UniqueFunction() {
+            reset();
+        }
+
+        explicit operator bool() const noexcept {
+            return mOps != nullptr;
+        }
+
+        R operator()(Args... args) {
+            if (mOps == nullptr) throw std::bad_function_call();
+            return mOps->invoke(&mStorage, std::forward<Args>(args)...);
+        }
+
+        // Whether a callable of type F is stored without a heap allocation.
+        template<typename F>
+        static constexpr bool fits() {
+            return sizeof(F) <= Capacity &&
+                   alignof(F) <= alignof(std::max_align_t) &&
+                   std::is_nothrow_move_constructible_v<F>;
+        }
+
+    private:
+        struct Ops {
+            R (*invoke)(void*, Args&&...);
+            void (*move)(void* dst, void* src) noexcept;
+            void (*destroy)(void*) noexcept;
+        };
+
+        template<typename D>
+        struct InlineOps {
+            static D* get(void* p) {
+                return std::launder(reinterpret_cast<D*>(p));
+            }
+            static R invoke(void* p, Args&&... args) {
+                return std::invoke(*get(p), std::forward<Args>(args)...);
+            }
+            static void move(void* dst, void* src) noexcept {
+                new (dst) D(std::move(*get(src)));
+                get(src)->~D();
+            }
+            static void destroy(void* p) noexcept {
+                get(p)->~D();
+            }
+            static constexpr Ops ops = {invoke, move, destroy};
+        };
+
+        template<typename D>
+        struct HeapOps {
+            static D*& get(void* p) {
+                return *std::launder(reinterpret_cast<D**>(p));
+            }
+            static R invoke(void* p, Args&&... args) {
+                return std::invoke(*get(p), std::forward<Args>(args)...);
+            }
+            static void move(void* dst, void* src) noexcept {
+                new (dst) D*(get(src));
+            }
+            static void destroy(void* p) noexcept {
+                delete get(p);
+            }
+            static constexpr Ops ops = {invoke, move, destroy};
+        };
+
+        void take(UniqueFunction& rhs) noexcept {
+            if (rhs.mOps) {
+                rhs.mOps->move(&mStorage, &rhs.mStorage);
+                mOps = rhs.mOps;
+                rhs.mOps = nullptr;
+            }
+        }
+
+        void reset() noexcept {
+            if (mOps) {
+                mOps->destroy(&mStorage);
+                mOps = nullptr;
+            }
+        }
+
+        std::aligned_storage_t<Capacity, alignof(std::max_align_t)> mStorage;
+        const Ops* mOps = nullptr;
+};
+}
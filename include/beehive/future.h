@@ -0,0 +1,206 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <beehive/pool.h>
+#include <beehive/recycler.h>
+#include <beehive/task.h>
+
+namespace beehive {
+// Callbacks waiting on a future. They are called on the thread that makes
+// the future ready, so they should be short: typically, they queue a task.
+class Continuations {
+    public:
+        explicit Continuations(Pool*);
+
+        Continuations(const Continuations&) = delete;
+        Continuations& operator=(const Continuations&) = delete;
+
+        // Where tasks depending on the future are scheduled.
+        Pool* pool() const;
+
+        // Calls c once the future is ready, or right away if it already is.
+        void add(Task::Callable c);
+        // Marks the future as ready, and calls everything added so far.
+        void fire();
+        bool ready() const;
+
+    private:
+        Pool* mPool;
+        mutable std::mutex mMutex;
+        bool mReady = false;
+        std::vector<Task::Callable> mCallbacks;
+};
+
+// A std::shared_future that can have work chained to it without blocking.
+template<typename R>
+class Future : public std::shared_future<R> {
+    public:
+        using Result = R;
+
+        Future() = default;
+        Future(std::shared_future<R> f, std::shared_ptr<Continuations> c) :
+            std::shared_future<R>(std::move(f)), mContinuations(std::move(c)) {}
+
+        // Schedules f(*this) once this future is ready, and returns a future
+        // for its result. f sees the exception, if any, when it calls get().
+        template<typename F>
+        auto then(F&& f, Task::Priority p = Task::DefaultPriority) const;
+
+        // Awaiting a Future suspends the coroutine without blocking its
+        // thread, and resumes it on a worker once the future is ready.
+        bool await_ready() const {
+            return !mContinuations || mContinuations->ready();
+        }
+        void await_suspend(std::coroutine_handle<> h) const {
+            Pool* pool = mContinuations->pool();
+            mContinuations->add([pool, h] () -> void {
+                pool->post([h] () -> void { h.resume(); });
+            });
+        }
+        decltype(auto) await_resume() const {
+            return this->get();
+        }
+
+        const std::shared_ptr<Continuations>& continuations() const {
+            if (!mContinuations) throw std::future_error(std::future_errc::no_state);
+            return mContinuations;
+        }
+
+    private:
+        std::shared_ptr<Continuations> mContinuations;
+};
+
+// Wraps f() into a task that fulfills the returned future, and then runs
+// whatever was chained to it.
+template<typename F>
+auto package(Pool* pool, F&& f) {
+    using R = std::invoke_result_t<std::decay_t<F>&>;
+    auto after = std::allocate_shared<Continuations>(RecyclingAllocator<Continuations>(), pool);
+    std::promise<R> flower(std::allocator_arg, RecyclingAllocator<char>());
+    Future<R> pollen(flower.get_future().share(), after);
+    auto task = [f = std::forward<F>(f), flower = std::move(flower), after = std::move(after)] () mutable -> void {
+        try {
+            if constexpr (std::is_same_v<R, void>) {
+                f();
+                flower.set_value();
+            } else {
+                flower.set_value(f());
+            }
+        } catch (...) {
+            flower.set_exception(std::current_exception());
+        }
+        after->fire();
+    };
+    return std::make_pair(Task::Callable(std::move(task)), std::move(pollen));
+}
+
+template<typename R>
+template<typename F>
+auto Future<R>::then(F&& f, Task::Priority p) const {
+    auto& after = continuations();
+    Pool* pool = after->pool();
+    auto [task, next] = package(pool, [f = std::forward<F>(f), self = *this] () mutable -> decltype(auto) {
+        return f(std::move(self));
+    });
+    after->add([pool, p, task = std::move(task)] () mutable -> void {
+        pool->post(std::move(task), p);
+    });
+    return next;
+}
+
+// The result of when_any: the index of the first input to become ready,
+// and all of the inputs.
+template<typename R>
+struct WhenAny {
+    size_t index;
+    std::vector<Future<R>> futures;
+};
+
+// A future that becomes ready once all of [first, last) are, holding them.
+// Nothing is scheduled: the last input to finish completes it.
+template<typename Iter>
+auto when_all(Pool* pool, Iter first, Iter last) {
+    using In = typename std::iterator_traits<Iter>::value_type;
+    struct State {
+        std::vector<In> futures;
+        std::atomic<size_t> left;
+        std::promise<std::vector<In>> flower;
+        std::shared_ptr<Continuations> after;
+    };
+    auto state = std::make_shared<State>();
+    state->futures.assign(first, last);
+    state->left = state->futures.size() + 1;
+    state->after = std::make_shared<Continuations>(pool);
+    Future<std::vector<In>> pollen(state->flower.get_future().share(), state->after);
+
+    auto arrive = [state] () -> void {
+        if (state->left.fetch_sub(1) != 1) return;
+        state->flower.set_value(std::move(state->futures));
+        state->after->fire();
+    };
+    for (const auto& f : state->futures) f.continuations()->add(arrive);
+    arrive();
+    return pollen;
+}
+
+// A future that becomes ready as soon as any of [first, last) is.
+template<typename Iter>
+auto when_any(Pool* pool, Iter first, Iter last) {
+    using In = typename std::iterator_traits<Iter>::value_type;
+    using Any = WhenAny<typename In::Result>;
+    struct State {
+        std::vector<In> futures;
+        std::promise<Any> flower;
+        std::shared_ptr<Continuations> after;
+    };
+    auto state = std::make_shared<State>();
+    state->futures.assign(first, last);
+    if (state->futures.empty()) throw std::invalid_argument("when_any needs at least one future");
+    state->after = std::make_shared<Continuations>(pool);
+    Future<Any> pollen(state->flower.get_future().share(), state->after);
+
+    // Inputs still call back once the first one has, and may do so much
+    // later. They share this link, which the first one empties, rather than
+    // keep the state and the values it holds alive until the slowest.
+    struct Link {
+        std::atomic<bool> done{false};
+        std::shared_ptr<State> state;
+    };
+    auto link = std::make_shared<Link>();
+    link->state = state;
+    for (size_t i = 0; i < state->futures.size(); ++i) {
+        state->futures[i].continuations()->add([link, i] () -> void {
+            if (link->done.exchange(true)) return;
+            auto held = std::move(link->state);
+            held->flower.set_value(Any{i, held->futures});
+            held->after->fire();
+        });
+    }
+    return pollen;
+}
+}
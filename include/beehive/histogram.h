@@ -0,0 +1,74 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace beehive {
+// Counts of durations, in buckets that grow exponentially: each power of two
+// is split in SubBuckets linear ones, so that any value is known to within
+// 1/SubBuckets of itself, from a nanosecond to centuries.
+class Histogram {
+    public:
+        static constexpr size_t SubBits = 3;
+        static constexpr size_t SubBuckets = size_t(1) << SubBits;
+        static constexpr size_t Buckets = (64 - SubBits + 1) * SubBuckets;
+
+        // The bucket a value falls in, and the range of values it holds.
+        static size_t bucket(uint64_t);
+        static uint64_t lower(size_t);
+        static uint64_t upper(size_t);
+
+        void add(std::chrono::nanoseconds, uint64_t n = 1);
+        void merge(const Histogram&);
+
+        uint64_t count() const;
+        uint64_t count(size_t bucket) const;
+        // The upper bound of the bucket holding the value at that quantile,
+        // from 0 to 1. Zero if the histogram is empty.
+        std::chrono::nanoseconds quantile(double) const;
+        std::chrono::nanoseconds max() const;
+
+    private:
+        friend class AtomicHistogram;
+
+        std::array<uint64_t, Buckets> mCounts{};
+        uint64_t mCount = 0;
+};
+
+// A Histogram with a single writer, which others can read at any time. Reads
+// are not atomic as a whole, but every value is counted once it is seen.
+class AtomicHistogram {
+    public:
+        AtomicHistogram() = default;
+
+        AtomicHistogram(const AtomicHistogram&) = delete;
+        AtomicHistogram& operator=(const AtomicHistogram&) = delete;
+
+        // Only from the writing thread.
+        void add(std::chrono::nanoseconds);
+        // Adds the counts seen so far to the histogram.
+        void addto(Histogram*) const;
+
+    private:
+        std::array<std::atomic<uint64_t>, Histogram::Buckets> mCounts{};
+};
+}
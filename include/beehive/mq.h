@@ -18,74 +18,139 @@ limitations under the License.
 
 #include <chrono>
 #include <mutex>
-#include <condition_variable>
-#include <queue>
 #include <thread>
 #include <optional>
 #include <variant>
+#include <vector>
 #include <functional>
+#include <beehive/parker.h>
+#include <beehive/platform.h>
+#include <beehive/ring.h>
 
 namespace beehive {
 
+// Messages are kept in a ring that doubles when full and never shrinks, so
+// that once it has grown to the longest backlog seen, sending and receiving
+// no longer allocate.
 template<typename MsgType>
 class MessageQueue {
     public:
-        MessageQueue() = default;
+        MessageQueue() : mRing(InitialCapacity) {}
         ~MessageQueue() = default;
 
         void send(MsgType msg) {
             std::unique_lock<std::mutex> lk(mQueueMutex);
-            mQueue.push(msg);
+            if (mSize == mRing.size()) grow();
+            mRing[(mHead + mSize) % mRing.size()] = std::move(msg);
+            ++mSize;
         }
 
         bool empty() {
             std::unique_lock<std::mutex> lk(mQueueMutex);
-            return mQueue.empty();
+            return mSize == 0;
         }
 
         std::optional<MsgType> receive() {
             std::unique_lock<std::mutex> lk(mQueueMutex);
 
-            if (mQueue.empty()) return std::nullopt;
+            if (mSize == 0) return std::nullopt;
 
-            auto msg = mQueue.front();
-            mQueue.pop();
+            std::optional<MsgType> msg = std::move(mRing[mHead]);
+            mRing[mHead].reset();
+            mHead = (mHead + 1) % mRing.size();
+            --mSize;
             return msg;
         }
 
     private:
+        static constexpr size_t InitialCapacity = 64;
+
         MessageQueue(const MessageQueue&) = delete;
 
+        // Unrolls the ring into one twice as large.
+        void grow() {
+            std::vector<std::optional<MsgType>> ring(2 * mRing.size());
+            for (size_t i = 0; i < mSize; ++i) {
+                ring[i] = std::move(mRing[(mHead + i) % mRing.size()]);
+            }
+            mRing.swap(ring);
+            mHead = 0;
+        }
+
         std::mutex mQueueMutex;
-        std::queue<MsgType> mQueue;
+        std::vector<std::optional<MsgType>> mRing;
+        size_t mHead = 0;
+        size_t mSize = 0;
 };
 
-template<typename MsgType>
-class SignalingQueue {
+// Same interface as MessageQueue, backed by a lock-free RingBuffer.
+// Senders yield until there is room if the ring ever fills up.
+template<typename MsgType, size_t Capacity = 1024>
+class RingMessageQueue {
     public:
-        enum class Result {
-            CONTINUE,
-            ERROR,
-            FINISH,
-        };
+        RingMessageQueue() : mRing(Capacity) {}
+        ~RingMessageQueue() = default;
+
+        void send(MsgType msg) {
+            while (!mRing.trypush(msg)) {
+                std::this_thread::yield();
+            }
+        }
+
+        bool empty() {
+            return mRing.empty();
+        }
+
+        std::optional<MsgType> receive() {
+            return mRing.trypop();
+        }
+
+    private:
+        RingMessageQueue(const RingMessageQueue&) = delete;
 
+        RingBuffer<MsgType> mRing;
+};
+
+// Shared by every SignalingQueue, whatever queue backs it, so that handlers
+// need not care about how their messages are delivered.
+struct SignalingQueueBase {
+    enum class Result {
+        CONTINUE,
+        ERROR,
+        FINISH,
+    };
+};
+
+template<typename MsgType, typename Queue = MessageQueue<MsgType>>
+class SignalingQueue : public SignalingQueueBase {
+    public:
         SignalingQueue() = default;
         ~SignalingQueue() = default;
 
         void send(MsgType m) {
-            mQueue.send(m);
-            mWaitCV.notify_all();
+            mQueue.send(std::move(m));
+            mParker.unpark();
         }
 
+        // Only one thread may receive from a SignalingQueue. When the queue is
+        // empty, it polls for up to spin() before going to sleep.
         MsgType receive() {
-            loop:
-                while(mQueue.empty()) {
-                    std::unique_lock<std::mutex> lk(mWaitMutex);
-                    mWaitCV.wait_for(lk, std::chrono::milliseconds(100));
-                }
+            while (true) {
                 std::optional<MsgType> m = mQueue.receive();
-                if (m.has_value()) return *m;
-                goto loop;
+                if (m.has_value()) return std::move(*m);
+                if (mSpin.count() > 0) {
+                    m = poll();
+                    if (m.has_value()) return std::move(*m);
+                }
+                mParker.park();
+            }
+        }
+
+        std::chrono::nanoseconds spin() const {
+            return mSpin;
+        }
+        void spin(std::chrono::nanoseconds s) {
+            mSpin = s;
         }
     
         void loop(typename MsgType::Handler* h) {
@@ -97,9 +162,21 @@ class SignalingQueue {
         }
 
     private:
-        MessageQueue<MsgType> mQueue;
-        std::mutex mWaitMutex;
-        std::condition_variable mWaitCV;
+        // Busy-waits for a message, yielding the CPU every now and then.
+        std::optional<MsgType> poll() {
+            auto deadline = std::chrono::steady_clock::now() + mSpin;
+            for (size_t i = 1; std::chrono::steady_clock::now() < deadline; ++i) {
+                if (i % 16 == 0) std::this_thread::yield();
+                else Platform::relax();
+                std::optional<MsgType> m = mQueue.receive();
+                if (m.has_value()) return m;
+            }
+            return std::nullopt;
+        }
+
+        Queue mQueue;
+        Parker mParker;
+        std::chrono::nanoseconds mSpin{0};
 };
 
 template<typename MsgType>
@@ -107,18 +184,28 @@ class HandlerThread : public MsgType::Handler {
     public:
         using SQ = SignalingQueue<MsgType>;
 
-        HandlerThread() : mQueue(std::make_unique<SQ>()) {
-            mThread = std::thread(std::bind(&HandlerThread::loop, this));
+        HandlerThread() : mQueue(std::make_unique<SQ>()) {}
+
+        // Starts the thread, unless it already runs. Our constructor cannot
+        // do it, as the thread would call into a subclass not yet built, so
+        // this is done on first use, by any of the methods below.
+        void start() {
+            std::call_once(mStarted, [this] () -> void {
+                mThread = std::thread(std::bind(&HandlerThread::loop, this));
+            });
         }
 
         SQ* queue() {
+            start();
             return mQueue.get();
         }
 
         void join() {
+            start();
             mThread.join();
         }
         void detach() {
+            start();
             mThread.detach();
         }
     protected:
@@ -131,6 +218,7 @@ class HandlerThread : public MsgType::Handler {
         }
 
         std::unique_ptr<SQ> mQueue;
+        std::once_flag mStarted;
         std::thread mThread;
 };
 }
@@ -0,0 +1,43 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+
+namespace beehive {
+// Lets one thread sleep until another one has something for it.
+// unpark() leaves a token behind if nobody is parked, and the next park()
+// consumes it without sleeping, so that a wakeup can never be lost.
+// Only a single thread may park on a given Parker.
+class Parker {
+    public:
+        Parker();
+
+        Parker(const Parker&) = delete;
+        Parker& operator=(const Parker&) = delete;
+
+        void park();
+        void unpark();
+
+    private:
+        static constexpr int PARKED = -1;
+        static constexpr int EMPTY = 0;
+        static constexpr int NOTIFIED = 1;
+
+        std::atomic<int> mState;
+};
+}
@@ -16,19 +16,80 @@ limitations under the License.
 
 #pragma once
 #include <stddef.h>
+#include <atomic>
+#include <string>
 #include <thread>
 #include <vector>
 
 namespace beehive {
+// Where each logical CPU sits in the machine. Packages, nodes, caches and
+// cores are numbered densely from 0, in the order of their first CPU.
+struct Topology {
+    struct Cpu {
+        // As numbered by the kernel, and used in affinity masks.
+        size_t id;
+        size_t package;
+        // The NUMA node, whose memory is the closest.
+        size_t node;
+        // CPUs that share the last-level cache.
+        size_t llc;
+        // The physical core: SMT siblings share it.
+        size_t core;
+        // Listed in isolcpus or nohz_full, and so best left alone.
+        bool isolated;
+    };
+
+    std::vector<Cpu> cpus;
+    size_t packages = 0;
+    size_t nodes = 0;
+    size_t llcs = 0;
+    size_t cores = 0;
+};
+
+// Which CPUs threads are pinned to, one each, in turn.
+enum class Placement {
+    // No pinning: the scheduler is free to move threads around.
+    NONE,
+    // Fill each core, cache and package before moving on to the next.
+    COMPACT,
+    // Alternate between packages, and use every core before any sibling.
+    SCATTER,
+    // One thread per physical core, as COMPACT but skipping SMT siblings.
+    CORES,
+};
+
 class Platform {
     public:
+        // Size used to keep hot, independently written data on separate lines.
+        static constexpr size_t CacheLine = 64;
+
         static size_t numprocessors();
 
+        // The topology of the online CPUs, as read once from sysfs. Parts
+        // that cannot be read are taken to be shared by all CPUs.
+        static const Topology& topology();
+        // As above, from the tree sysfs has under /sys/devices/system.
+        static Topology topology(const std::string& root);
+        // The ids of the CPUs to pin threads to, in the order to use them.
+        // Isolated CPUs only come in when there are no others. Empty for
+        // Placement::NONE.
+        static std::vector<size_t> placement(const Topology&, Placement);
+        // Parses a kernel CPU list, such as "0-3,8,10-11".
+        static std::vector<size_t> cpulist(const std::string&);
+
         static std::vector<bool> affinity(std::thread::native_handle_type);
         static void affinity(std::thread::native_handle_type, const std::vector<bool>&);
 
         static std::string name(std::thread::native_handle_type);
         static void name(std::thread::native_handle_type, const char*);
+
+        // Hints the CPU that the caller is busy-waiting.
+        static void relax();
+
+        // Sleeps as long as the value still equals the expected one, or until
+        // woken. May return spuriously.
+        static void wait(std::atomic<int>*, int);
+        static void wake(std::atomic<int>*, int = 1);
     private:
         Platform() = delete;
 };
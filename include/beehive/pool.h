@@ -19,9 +19,23 @@ limitations under the License.
 #include <stddef.h>
 #include <beehive/task.h>
 #include <beehive/pq.h>
+#include <beehive/deque.h>
+#include <beehive/bitmap.h>
+#include <beehive/platform.h>
 #include <beehive/idempotency.h>
+#include <beehive/timer.h>
+#include <beehive/trace.h>
 #include <beehive/worker.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <map>
 #include <memory>
+#include <optional>
+#include <stop_token>
+#include <variant>
 #include <vector>
 #include <stack>
 #include <queue>
@@ -30,7 +44,75 @@ limitations under the License.
 namespace beehive {
 class Pool {
     public:
+        // Upper bound on the number of workers a single Pool can host.
+        static constexpr size_t MaxWorkers = 1024;
+
+        enum class Scheduling {
+            // All tasks go through one queue shared by the whole pool.
+            SHARED,
+            // Each worker owns a deque. Tasks scheduled from a worker go to
+            // its own deque, and idle workers steal from the others.
+            STEALING,
+        };
+
+        // How the SHARED queue orders tasks.
+        enum class Queue {
+            // A binary heap. Tasks of equal priority come out in no
+            // particular order.
+            HEAP,
+            // One FIFO per priority level, in constant time.
+            BUCKETS,
+            // Earliest deadline first. Priorities are ignored, and tasks
+            // without a deadline run once no task with one is waiting.
+            DEADLINE,
+        };
+
+        // How workers and queues map onto the machine.
+        enum class Layout {
+            // Workers run anywhere, and share one queue.
+            FLAT,
+            // The pool is split in one domain per last-level cache, or per
+            // NUMA node. Workers are spread evenly over the domains, and
+            // pinned to their CPUs. Each domain has a queue of its own,
+            // and workers only look in other domains, nearest first, when
+            // theirs has nothing left. Priorities hold within a domain.
+            LLC,
+            NUMA,
+        };
+
+        // Names a domain, as a hint to schedule. Ids go from 0 to domains().
+        struct Domain {
+            size_t id;
+        };
+
+        struct Options {
+            Scheduling scheduling = Scheduling::SHARED;
+            Queue queue = Queue::HEAP;
+            Layout layout = Layout::FLAT;
+            // Pins each worker to a CPU of its domain, in the given order.
+            // CPUs listed in isolcpus or nohz_full are left out.
+            Placement placement = Placement::NONE;
+            Worker::Mailbox mailbox = Worker::Mailbox::LOCKED;
+            // How long an idle worker polls for new messages before it goes
+            // to sleep. Spinning trades CPU time for wakeup latency.
+            std::chrono::nanoseconds spin{0};
+            // When non-zero, a task in the SHARED queue gains one priority
+            // level for each period of this length it spends waiting, so
+            // that low priority work is not starved. Aging needs the BUCKETS
+            // queue, which it selects, unless the DEADLINE queue is asked
+            // for: aging is then ignored.
+            std::chrono::nanoseconds aging{0};
+            // How late a timer may fire, so that timers due at about the
+            // same time share one wakeup of the timer thread.
+            std::chrono::nanoseconds timerSlack{0};
+            // When non-zero, each worker keeps that many of its latest trace
+            // events, for dumpTrace. Tasks queued from outside the pool
+            // share a buffer of the same size.
+            size_t tracing = 0;
+        };
+
         Pool(size_t = 0);
+        Pool(size_t, const Options&);
         ~Pool();
 
         Pool(const Pool&) = delete;
@@ -40,28 +122,185 @@ class Pool {
 
         size_t size() const;
         std::shared_future<void> schedule(Task::Callable, Task::Priority = Task::DefaultPriority);
+        // Fails the future with DeadlineExceeded, without running the task,
+        // if no worker got to it before the deadline.
+        std::shared_future<void> schedule(Task::Callable, Task::Clock::time_point deadline,
+                                          Task::Priority = Task::DefaultPriority);
+        // Queues all the tasks at once, and wakes no more workers than needed.
+        std::vector<std::shared_future<void>> scheduleBatch(std::vector<Task::Callable>,
+                                                            Task::Priority = Task::DefaultPriority);
+        // Requesting a stop on the token cancels the tasks that have not
+        // started yet: see Task::cancellable.
+        std::shared_future<void> schedule(Task::Callable, std::stop_token,
+                                          Task::Priority = Task::DefaultPriority);
+        std::vector<std::shared_future<void>> scheduleBatch(std::vector<Task::Callable>, std::stop_token,
+                                                            Task::Priority = Task::DefaultPriority);
+        // Queues the task in the given domain, where it will most likely
+        // run. Without a hint, tasks go to the domain of the worker that
+        // schedules them, or to each domain in turn.
+        std::shared_future<void> schedule(Task::Callable, Domain, Task::Priority = Task::DefaultPriority);
+        // Queue the callable after a delay, at a given time, or every
+        // interval, without holding a worker in the meantime. The returned
+        // timer can be cancelled.
+        TimerWheel::Timer scheduleAfter(Task::Clock::duration, Task::Callable,
+                                        Task::Priority = Task::DefaultPriority);
+        TimerWheel::Timer scheduleAt(Task::Clock::time_point, Task::Callable,
+                                     Task::Priority = Task::DefaultPriority);
+        TimerWheel::Timer schedulePeriodic(Task::Clock::duration interval, Task::Callable,
+                                           Task::Priority = Task::DefaultPriority);
+
+        // As schedule, without the cost of a future. The callable must not
+        // throw.
+        void post(Task::Callable, Task::Priority = Task::DefaultPriority);
+
+        // co_await pool.schedule_on() moves the coroutine onto a worker.
+        struct Resume {
+            Pool* pool;
+            Task::Priority priority;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) const {
+                pool->post([h] () -> void { h.resume(); }, priority);
+            }
+            void await_resume() const noexcept {}
+        };
+        Resume schedule_on(Task::Priority = Task::DefaultPriority);
 
         bool idle() const;
-        std::shared_ptr<Task> task();
+        // How many tasks are queued, give or take those being moved around.
+        size_t pending() const;
+        size_t idleworkers() const;
 
         std::vector<Worker::Stats> stats();
+
+        struct Latency {
+            // The priority levels of the band.
+            Task::Priority lowest;
+            Task::Priority highest;
+            // How long tasks spent queued, and then running, on workers.
+            Histogram wait;
+            Histogram run;
+            // How many tasks of the band are queued right now.
+            size_t depth;
+        };
+        // One per priority band, lowest first, merged from all workers.
+        // With the DEADLINE queue, tasks all count as DefaultPriority.
+        std::vector<Latency> latency();
+        // The longest time a task spent queued, for each priority level
+        // that has seen any task. With the DEADLINE queue, tasks all count
+        // as DefaultPriority.
+        std::map<Task::Priority, std::chrono::nanoseconds> waits() const;
         Worker::View worker(int);
 
         void dump();
+        // Writes the trace events held so far to a file, in the Chrome trace
+        // event format. Returns false if tracing is off, or the file could
+        // not be written.
+        bool dumpTrace(const std::string& path);
+
+        size_t domains() const;
+        // The domain of a worker, by id.
+        size_t domain(int) const;
 
         void addworker();
+        // Stops the most recently added worker once it is done with the task
+        // at hand, if any, without waiting for it. Its queued tasks are left
+        // to the other workers. Returns false, and does nothing, if that
+        // would leave the pool empty, or if called from that very worker.
+        bool removeworker();
 
         IdempotencySet& idempotency();
 
+        const Options& options() const;
+
     private:
+        friend class Worker;
+
+        using Deque = StealingDeque<Task::Priority, std::shared_ptr<Task>>;
+        using HeapQueue = PriorityQueue<Task::Priority, std::shared_ptr<Task>>;
+        using BucketsQueue = BucketQueue<std::shared_ptr<Task>>;
+        using DeadlineQueue = PriorityQueue<Task::Clock::time_point, std::shared_ptr<Task>, MinFirst>;
+        using SharedQueue = std::variant<HeapQueue, BucketsQueue, DeadlineQueue>;
+
+        // Takes the next task to run, if any, and tells its priority.
+        std::shared_ptr<Task> task(Task::Priority* = nullptr);
+        // Called by a worker that ran out of tasks. Returns false, and leaves
+        // the worker marked busy, if tasks showed up in the meantime.
+        bool park(int);
+
         Worker* at(size_t) const;
+        void layout();
+        // Deletes the retired workers that are done, or all of them, with
+        // mResizeMutex held.
+        void reap(bool wait);
+        std::vector<bool> cpus(size_t) const;
 
         void foreachworker(std::function<void(std::unique_ptr<Worker>&)>);
 
+        using Tasks = std::vector<std::shared_ptr<Task>>;
+
+        // Both return the domain the tasks went to.
+        size_t enqueue(Task::Priority, std::shared_ptr<Task>, std::optional<size_t> domain = {});
+        size_t enqueue(Task::Priority, Tasks&&);
+        size_t home();
+        size_t target(size_t domain);
+        std::shared_ptr<Task> steal(Task::Priority*);
+        std::shared_ptr<Task> trypop(SharedQueue&, Task::Priority*);
+        void waited(Task::Priority, const Task&);
+        // The priority a task is accounted under.
+        Task::Priority accounted(Task::Priority) const;
+        void traced(TraceBuffer::Event, const Task&, Task::Priority);
+        // Prefers workers parked in the given domain.
+        void wake(size_t, size_t domain);
+
+        Options mOptions;
+        TimerWheel mTimers;
+
         mutable std::recursive_mutex mWorkersMutex;
+        // Serializes addworker and removeworker, and guards mRetired.
+        std::mutex mResizeMutex;
         std::vector<std::unique_ptr<Worker>> mWorkers;
+        // Removed workers that may still be finishing a task.
+        std::vector<std::unique_ptr<Worker>> mRetired;
+
+        // Workers by id, readable without holding mWorkersMutex, and the set
+        // of those that are waiting for something to do.
+        std::array<std::atomic<Worker*>, MaxWorkers> mWorkerIds{};
+        AtomicBitmap<MaxWorkers> mParked;
+        // Threads in the middle of waking a worker they picked out of
+        // mWorkerIds, which reap waits out before deleting a worker.
+        std::atomic<size_t> mWaking{0};
+
+        // One per domain, fixed at construction.
+        std::deque<SharedQueue> mTasks;
+        // Nanoseconds, by priority level, and -1 for levels never seen.
+        std::array<std::atomic<int64_t>, Task::MaxPriority + 1> mMaxWait;
+        // Queued tasks, by priority band.
+        std::array<std::atomic<int64_t>, Task::Bands> mDepth{};
+
+        // Deques are only allocated in STEALING mode, one per worker id, and
+        // are never released before the Pool is, so that they can be read
+        // without holding mWorkersMutex.
+        std::vector<std::unique_ptr<Deque>> mDequeStore;
+        std::array<std::atomic<Deque*>, MaxWorkers> mDeques{};
+        std::atomic<size_t> mNumDeques{0};
+        std::atomic<size_t> mNextDeque{0};
+
+        struct DomainInfo {
+            // The CPUs workers of the domain are pinned to, if any, and
+            // those they are each pinned to in turn with a placement.
+            std::vector<bool> cpus;
+            std::vector<size_t> placed;
+            // All domains, this one first, then nearest first.
+            std::vector<size_t> order;
+            AtomicBitmap<MaxWorkers>::Mask workers{};
+        };
+        std::vector<DomainInfo> mDomains;
+        std::atomic<size_t> mNextDomain{0};
 
-        PriorityQueue<Task::Priority, std::shared_ptr<Task>> mTasks;
+        // Trace events of threads outside of the pool.
+        std::mutex mTraceMutex;
+        std::unique_ptr<TraceBuffer> mTrace;
 
         IdempotencySet mIdempotencySet;
 };
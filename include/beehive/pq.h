@@ -16,10 +16,13 @@ limitations under the License.
 
 #pragma once
 
+#include <array>
+#include <deque>
 #include <mutex>
 #include <queue>
 #include <vector>
 #include <optional>
+#include <stdint.h>
 
 namespace beehive {
 constexpr bool MaxFirst = true;
@@ -34,7 +37,14 @@ class PriorityQueue {
 
         void push(Key k, Value v) {
             std::unique_lock<std::mutex> lk(mValuesMutex);
-            mValues.emplace(k,v);
+            mValues.emplace(k, std::move(v));
+        }
+
+        // Pushes a whole range at the same priority, taking the lock once.
+        template<typename Iter>
+        void push(Key k, Iter begin, Iter end) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            for (; begin != end; ++begin) mValues.emplace(k, *begin);
         }
 
         bool empty() const {
@@ -86,4 +96,122 @@ class PriorityQueue {
         };
         std::priority_queue<Object, std::vector<Object>, Comparator> mValues;
 };
+
+// A priority queue for 8-bit keys, with one FIFO per key. push and pop take
+// constant time, values of the same priority come out in the order they
+// went in, and a bitmap of non-empty buckets finds the next one to serve.
+template<typename Value, bool Order = true>
+class BucketQueue {
+    public:
+        using Key = uint8_t;
+
+        BucketQueue() = default;
+        ~BucketQueue() = default;
+
+        void push(Key k, Value v) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            mBuckets[k].emplace_back(std::move(v));
+            mOccupied[k / 64] |= uint64_t(1) << (k % 64);
+            ++mSize;
+        }
+
+        template<typename Iter>
+        void push(Key k, Iter begin, Iter end) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            auto& bucket = mBuckets[k];
+            auto n = bucket.size();
+            bucket.insert(bucket.end(), begin, end);
+            mSize += bucket.size() - n;
+            if (!bucket.empty()) mOccupied[k / 64] |= uint64_t(1) << (k % 64);
+        }
+
+        bool empty() const {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            return mSize == 0;
+        }
+
+        size_t size() const {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            return mSize;
+        }
+
+        std::optional<Value> trypop(Key* priority = nullptr) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            if (mSize == 0) return std::nullopt;
+            return take(priority);
+        }
+
+        // As trypop, but serves the bucket whose oldest value ranks highest
+        // according to rank(key, value), e.g. to let long-waiting values
+        // overtake higher keys. Ties go to the bucket trypop would pick.
+        template<typename Rank>
+        std::optional<Value> trypop(Key* priority, Rank rank) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            if (mSize == 0) return std::nullopt;
+            Key best = next();
+            auto bestRank = rank(best, mBuckets[best].front());
+            for (size_t w = 0; w < Words; ++w) {
+                for (auto bits = mOccupied[w]; bits; bits &= bits - 1) {
+                    Key k = w * 64 + __builtin_ctzll(bits);
+                    auto r = rank(k, mBuckets[k].front());
+                    if (r > bestRank) {
+                        best = k;
+                        bestRank = r;
+                    }
+                }
+            }
+            return take(best, priority);
+        }
+
+        Value pop(Key* priority = nullptr) {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            return take(priority);
+        }
+
+        Key priority() {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            return next();
+        }
+
+        Value peek() {
+            std::unique_lock<std::mutex> lk(mValuesMutex);
+            return mBuckets[next()].front();
+        }
+
+    private:
+        static constexpr size_t Words = 256 / 64;
+
+        // The bucket to serve next. The queue must not be empty.
+        Key next() const {
+            if constexpr (Order) {
+                for (size_t w = Words; w-- > 0;) {
+                    if (mOccupied[w]) return w * 64 + 63 - __builtin_clzll(mOccupied[w]);
+                }
+            } else {
+                for (size_t w = 0; w < Words; ++w) {
+                    if (mOccupied[w]) return w * 64 + __builtin_ctzll(mOccupied[w]);
+                }
+            }
+            return 0;
+        }
+
+        Value take(Key* priority) {
+            return take(next(), priority);
+        }
+
+        Value take(Key k, Key* priority) {
+            auto& bucket = mBuckets[k];
+            Value v = std::move(bucket.front());
+            bucket.pop_front();
+            if (bucket.empty()) mOccupied[k / 64] &= ~(uint64_t(1) << (k % 64));
+            --mSize;
+            if (priority) *priority = k;
+            return v;
+        }
+
+        mutable std::mutex mValuesMutex;
+        std::array<std::deque<Value>, 256> mBuckets;
+        std::array<uint64_t, Words> mOccupied{};
+        size_t mSize = 0;
+};
 }
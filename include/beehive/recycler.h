@@ -0,0 +1,81 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstddef>
+#include <new>
+
+namespace beehive {
+// Hands out small blocks from per-thread free lists, so that the objects
+// created for every task (the Task itself, promises and their shared state)
+// can be reused instead of going back to the heap.
+// A block freed by another thread is returned to the list it came from,
+// so producer threads get back the memory their tasks used once workers
+// are done with it.
+class Recycler {
+    public:
+        // Blocks larger than this come straight from the heap.
+        static constexpr size_t MaxSize = 512;
+
+        struct Stats {
+            // Allocations served from a free list, and those that were not.
+            uint64_t hits;
+            uint64_t misses;
+        };
+
+        static void* allocate(size_t);
+        static void deallocate(void*, size_t);
+
+        static Stats stats();
+
+    private:
+        Recycler() = delete;
+};
+
+template<typename T>
+class RecyclingAllocator {
+    public:
+        using value_type = T;
+
+        RecyclingAllocator() = default;
+        template<typename U>
+        RecyclingAllocator(const RecyclingAllocator<U>&) {}
+
+        T* allocate(size_t n) {
+            if constexpr (alignof(T) > alignof(std::max_align_t)) {
+                return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+            } else {
+                return static_cast<T*>(Recycler::allocate(n * sizeof(T)));
+            }
+        }
+
+        void deallocate(T* p, size_t n) {
+            if constexpr (alignof(T) > alignof(std::max_align_t)) {
+                ::operator delete(p, std::align_val_t(alignof(T)));
+            } else {
+                Recycler::deallocate(p, n * sizeof(T));
+            }
+        }
+
+        template<typename U>
+        bool operator==(const RecyclingAllocator<U>&) const { return true; }
+        template<typename U>
+        bool operator!=(const RecyclingAllocator<U>&) const { return false; }
+};
+}
@@ -0,0 +1,114 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <beehive/platform.h>
+
+namespace beehive {
+// A bounded, lock-free, multi-producer multi-consumer queue.
+// Each slot carries a sequence number that tells producers and consumers
+// whose turn it is to use the slot, so that neither side ever needs a lock;
+// the head and tail counters live on separate cache lines.
+template<typename T>
+class RingBuffer {
+    public:
+        // The capacity is rounded up to the next power of two.
+        explicit RingBuffer(size_t capacity) {
+            size_t n = 2;
+            while (n < capacity) n <<= 1;
+            mMask = n - 1;
+            mSlots = std::make_unique<Slot[]>(n);
+            for (size_t i = 0; i < n; ++i) {
+                mSlots[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~RingBuffer() {
+            while (trypop());
+        }
+
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        size_t capacity() const {
+            return mMask + 1;
+        }
+
+        bool empty() const {
+            return mTail.load(std::memory_order_acquire) >= mHead.load(std::memory_order_acquire);
+        }
+
+        // Returns false, and leaves the value untouched, if the buffer is full.
+        bool trypush(T& v) {
+            size_t pos = mHead.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &mSlots[pos & mMask];
+                size_t seq = slot->seq.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = mHead.load(std::memory_order_relaxed);
+                }
+            }
+            new (&slot->storage) T(std::move(v));
+            slot->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        std::optional<T> trypop() {
+            size_t pos = mTail.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &mSlots[pos & mMask];
+                size_t seq = slot->seq.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    return std::nullopt;
+                } else {
+                    pos = mTail.load(std::memory_order_relaxed);
+                }
+            }
+            T* value = std::launder(reinterpret_cast<T*>(&slot->storage));
+            std::optional<T> ret(std::move(*value));
+            value->~T();
+            slot->seq.store(pos + mMask + 1, std::memory_order_release);
+            return ret;
+        }
+
+    private:
+        struct Slot {
+            std::atomic<size_t> seq;
+            std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+        };
+
+        alignas(Platform::CacheLine) std::atomic<size_t> mHead{0};
+        alignas(Platform::CacheLine) std::atomic<size_t> mTail{0};
+        alignas(Platform::CacheLine) size_t mMask;
+        std::unique_ptr<Slot[]> mSlots;
+};
+}
@@ -16,36 +16,94 @@ limitations under the License.
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <future>
 #include <memory>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
 #include <type_traits>
+#include <beehive/function.h>
 
 namespace beehive {
+// The error a task's future holds when its deadline passed before it could
+// start, and it was dropped instead of run.
+class DeadlineExceeded : public std::runtime_error {
+    public:
+        DeadlineExceeded() : std::runtime_error("task deadline exceeded") {}
+};
+
+// The error a task's future holds when it was cancelled before it started.
+class TaskCancelled : public std::runtime_error {
+    public:
+        TaskCancelled() : std::runtime_error("task cancelled") {}
+};
+
 class Task {
     public:
         using Priority = uint8_t;
         static constexpr Priority MinPriority = 0;
         static constexpr Priority DefaultPriority = 127;
         static constexpr Priority MaxPriority = 255;
+        // Statistics group priority levels in bands, lowest first.
+        static constexpr size_t Bands = 8;
+        static constexpr size_t band(Priority p) { return p / ((MaxPriority + 1) / Bands); }
+
+        // Move-only, and stored inline when small enough.
+        using Callable = UniqueFunction<void()>;
 
-        using Callable = std::function<void()>;
+        // Tasks built with Detached have no future, and must not throw.
+        struct Detached {};
 
         Task(Callable);
+        Task(Callable, Detached);
 
         std::shared_future<void>& future();
 
+        using Clock = std::chrono::steady_clock;
+        static constexpr Clock::time_point NoDeadline = Clock::time_point::max();
+
+        // A task that has not started by its deadline is not run at all.
+        Clock::time_point deadline() const;
+        void deadline(Clock::time_point);
+
+        // Once a stop is requested through the token, a task that has not
+        // started yet will not run, and its future fails with TaskCancelled
+        // right away. Running tasks have to poll the token themselves.
+        void cancellable(std::stop_token);
+
+        // When the task was last queued.
+        std::chrono::steady_clock::time_point enqueued() const;
+        void enqueued(std::chrono::steady_clock::time_point);
+
         void run();
 
     private:
+        // Marks the task as started, and returns false if it was already.
+        bool start();
+        void cancel();
+
+        struct OnStop {
+            Task* task;
+            void operator()() const { task->cancel(); }
+        };
+
         Callable mCallable;
-        std::promise<void> mPromise;
+        std::chrono::steady_clock::time_point mEnqueued;
+        Clock::time_point mDeadline = NoDeadline;
+        std::optional<std::promise<void>> mPromise;
         std::shared_future<void> mFuture;
+        // Only used by cancellable tasks, to settle who gets to the promise
+        // first between the worker and the stop callback.
+        std::atomic<bool> mStarted{false};
+        std::optional<std::stop_callback<OnStop>> mOnStop;
 };
 
 template<typename C, typename... Params>
 class SharedCallable {
     public:
-        using Ret = std::result_of_t<C(Params...)>;
+        using Ret = std::invoke_result_t<C&, Params...>;
         template<typename... Args>
         SharedCallable(Args... a) {
             mCallable = std::make_shared<C>(std::forward<Args>(a)...);
@@ -0,0 +1,123 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include <beehive/task.h>
+
+namespace beehive {
+// A hierarchical timing wheel: four levels of 64 slots, each level's slots
+// spanning 64 times more ticks than the one below. Timers are added and
+// cancelled in constant time, and move down a level whenever the level below
+// wraps around. A single thread, started with the first timer, sleeps until
+// the next expiry and hands expired timers to the dispatch function.
+class TimerWheel {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using Dispatch = std::function<void(Task::Callable, Task::Priority)>;
+
+        class Entry;
+
+        // Refers to a timer. It must not outlive its wheel.
+        class Timer {
+            public:
+                Timer() = default;
+
+                // Stops any further run of the timer. Returns false if there
+                // was none to stop: the timer already ran, or is running and
+                // is not periodic, or was cancelled already.
+                bool cancel();
+
+                explicit operator bool() const;
+
+            private:
+                friend class TimerWheel;
+                explicit Timer(std::shared_ptr<Entry>);
+
+                std::shared_ptr<Entry> mEntry;
+        };
+
+        // Expirations are rounded up to whole ticks, and then to a multiple
+        // of slack, so that timers close to each other share one wakeup.
+        TimerWheel(Dispatch, Clock::duration tick = std::chrono::milliseconds(1),
+                   Clock::duration slack = Clock::duration::zero());
+        ~TimerWheel();
+
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        // Runs f once at the given time, or every interval starting then.
+        // A periodic f is armed again only once it returns, so runs never
+        // overlap, and exceptions it throws are ignored.
+        Timer add(Clock::time_point, Task::Callable f, Task::Priority = Task::DefaultPriority);
+        Timer add(Clock::time_point, Clock::duration interval, Task::Callable f,
+                  Task::Priority = Task::DefaultPriority);
+
+        // Pending timers, not counting those being run.
+        size_t size() const;
+
+        // Stops the thread and drops every pending timer.
+        void stop();
+
+    private:
+        static constexpr size_t Levels = 4;
+        static constexpr size_t SlotBits = 6;
+        static constexpr size_t Slots = 1 << SlotBits;
+
+        using Slot = std::list<std::shared_ptr<Entry>>;
+
+        uint64_t tickof(Clock::time_point) const;
+        Clock::time_point timeof(uint64_t) const;
+
+        void insert(const std::shared_ptr<Entry>&);
+        void unlink(Entry&);
+        // The first tick after mNow at which something is due or has to move
+        // down a level, if anything is pending.
+        std::optional<uint64_t> next() const;
+        void advance(uint64_t, std::vector<std::shared_ptr<Entry>>* due);
+        void fire(std::shared_ptr<Entry>);
+        void rearm(const std::shared_ptr<Entry>&);
+        void loop();
+
+        Dispatch mDispatch;
+        const Clock::duration mTick;
+        const uint64_t mSlack;
+        const Clock::time_point mEpoch;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mWakeup;
+        bool mStopped = false;
+        uint64_t mNow = 0;
+        // When the thread next plans to wake up.
+        uint64_t mNextWake = UINT64_MAX;
+        size_t mSize = 0;
+        std::array<std::array<Slot, Slots>, Levels> mSlots;
+        std::array<uint64_t, Levels> mOccupied{};
+        std::thread mThread;
+};
+}
@@ -0,0 +1,83 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace beehive {
+// A ring of trace events, written by a single thread without locks, that
+// keeps the latest ones.
+class TraceBuffer {
+    public:
+        enum class Event : uint8_t {
+            // The argument is the task, and the extra byte its priority.
+            ENQUEUE,
+            DEQUEUE,
+            START,
+            END,
+            // A worker got a TASK message, or went to sleep.
+            WAKEUP,
+            PARK,
+            // The extra byte is the Message::Kind.
+            MESSAGE,
+        };
+
+        struct Record {
+            // Nanoseconds of the steady clock.
+            int64_t time;
+            Event event;
+            uint8_t extra;
+            // Only the low 48 bits are kept.
+            uint64_t arg;
+        };
+
+        explicit TraceBuffer(size_t capacity);
+
+        TraceBuffer(const TraceBuffer&) = delete;
+        TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+        // Only from the writing thread.
+        void add(Event, uint64_t arg = 0, uint8_t extra = 0);
+        // The events held, oldest first, leaving out any the writer
+        // overwrote while they were being read.
+        std::vector<Record> records() const;
+
+    private:
+        size_t mCapacity;
+        // Two words per record: the time, then the rest packed together.
+        std::unique_ptr<std::atomic<uint64_t>[]> mSlots;
+        std::atomic<uint64_t> mHead{0};
+};
+
+// The events of one thread, as it should show in a trace viewer.
+struct TraceTrack {
+    int tid;
+    std::string name;
+    std::vector<TraceBuffer::Record> records;
+};
+
+// Writes the tracks in the Chrome trace event format, as loaded by Perfetto
+// and chrome://tracing. Tasks show as spans linked to where they were
+// queued from, and parked workers as spans of their own.
+void writeChromeTrace(std::ostream&, const std::vector<TraceTrack>&);
+}
@@ -16,29 +16,46 @@ limitations under the License.
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <bits/stdint-uintn.h>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <beehive/mq.h>
 #include <chrono>
 #include <string>
+#include <variant>
 #include <vector>
-#include <beehive/timecounter.h>
 #include <beehive/mq.h>
 #include <beehive/message.h>
+#include <beehive/platform.h>
+#include <beehive/histogram.h>
+#include <beehive/task.h>
+#include <beehive/trace.h>
 
 namespace beehive {
 class Pool;
 
 class Worker : public Message::Handler {
     public:
+        enum class Mailbox {
+            // An unbounded ring guarded by a mutex.
+            LOCKED,
+            // A bounded lock-free ring buffer.
+            RING,
+        };
+
         struct Stats {
             uint64_t messages;
             uint64_t runs;
-            std::chrono::milliseconds idle;
-            std::chrono::milliseconds active;
+            // TASK messages received, and how many of those found no task.
+            uint64_t wakeups;
+            uint64_t wasted;
+            // Up to the time of the snapshot, including the current stretch.
+            std::chrono::nanoseconds idle;
+            std::chrono::nanoseconds active;
 
             bool operator==(const Stats&) const;
             bool operator!=(const Stats&) const;
@@ -77,6 +94,13 @@ class Worker : public Message::Handler {
         void send(Message);
 
         void exit();
+        // As exit, but the worker also stops running tasks as soon as it is
+        // done with the current one, instead of draining the queue.
+        void retire();
+        // Waits for the thread to finish, after exit().
+        void join();
+        // Whether the thread is done, and join() would not block.
+        bool finished() const;
         void task();
         void dump();
 
@@ -85,8 +109,18 @@ class Worker : public Message::Handler {
         std::string name();
         void name(const char*);
         int id() const;
+        Pool* pool() const;
+
+        // Returns the Worker running on the calling thread, if any.
+        static Worker* current();
 
         Stats stats();
+        // Adds how long the tasks this worker ran, in a priority band, spent
+        // queued and running.
+        void latency(size_t band, Histogram* wait, Histogram* run) const;
+        // Null unless the pool is tracing. Only the worker's own thread may
+        // add events.
+        TraceBuffer* trace() const;
         std::thread::id tid();
         std::thread::native_handle_type nativeid();
 
@@ -95,6 +129,7 @@ class Worker : public Message::Handler {
 
         Worker(Worker&&) = default;
 
+        Result handle(const Message&) override;
         void onBeforeMessage() override;
         void onAfterMessage() override;
 
@@ -106,29 +141,56 @@ class Worker : public Message::Handler {
     private:
         friend class Worker::View;
 
-        class AtomicStats {
+        // Written by the worker thread alone, without locks or read-modify-
+        // write instructions, and read by others through a sequence lock.
+        // Kept on cache lines of its own, so that readers and the worker's
+        // other fields do not get in the way.
+        class alignas(Platform::CacheLine) AtomicStats {
             public:
                 AtomicStats();
 
-                Stats load();
+                Stats load() const;
+                // Switches from idle to active, and back.
                 void message();
+                void done();
                 void run();
-                TimeCounter& active();
-                TimeCounter& idle();
+                void wakeup(bool wasted);
 
             private:
+                static int64_t now();
+                // Brackets updates, which readers retry across.
+                void begin();
+                void end();
+                template<typename T>
+                static void add(std::atomic<T>&, T);
+
+                std::atomic<uint32_t> mSequence{0};
                 std::atomic<uint64_t> mMessages{0};
                 std::atomic<uint64_t> mRuns{0};
-                TimeCounter mActive;
-                TimeCounter mIdle;
+                std::atomic<uint64_t> mWakeups{0};
+                std::atomic<uint64_t> mWasted{0};
+                // Nanoseconds, up to mSince, when the worker went idle or
+                // active as per mActive.
+                std::atomic<int64_t> mIdleTime{0};
+                std::atomic<int64_t> mActiveTime{0};
+                std::atomic<int64_t> mSince;
+                std::atomic<bool> mActive{false};
         };
 
         Pool* mParent;
         int mId;
 
+        using LockedQueue = SignalingQueue<Message>;
+        using RingQueue = SignalingQueue<Message, RingMessageQueue<Message>>;
+
         std::thread mWorkThread;
-        SignalingQueue<Message> mMsgQueue;
+        std::variant<LockedQueue, RingQueue> mMsgQueue;
         AtomicStats mStats;
+        std::array<AtomicHistogram, Task::Bands> mWaitTimes;
+        std::array<AtomicHistogram, Task::Bands> mRunTimes;
+        std::unique_ptr<TraceBuffer> mTrace;
+        std::atomic<bool> mRetiring{false};
+        std::atomic<bool> mFinished{false};
 
         void WorkLoop();
 };
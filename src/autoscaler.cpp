@@ -0,0 +1,92 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/autoscaler.h>
+#include <beehive/platform.h>
+#include <algorithm>
+
+using namespace beehive;
+
+Autoscaler::Autoscaler(Pool* pool, const Options& opts) : mPool(pool), mOptions(opts) {
+    if (mOptions.max == 0) mOptions.max = Platform::numprocessors();
+    mOptions.min = std::max<size_t>(1, mOptions.min);
+    mOptions.max = std::min(std::max(mOptions.max, mOptions.min), Pool::MaxWorkers);
+    mThread = std::thread([this] () -> void {
+        loop();
+    });
+    Platform::name(mThread.native_handle(), "beehive-scaler");
+}
+
+Autoscaler::~Autoscaler() {
+    {
+        std::unique_lock<std::mutex> lk(mMutex);
+        mStopped = true;
+    }
+    mWakeup.notify_one();
+    mThread.join();
+}
+
+int Autoscaler::step() {
+    std::unique_lock<std::mutex> lk(mStepMutex);
+    std::chrono::nanoseconds active{0};
+    std::chrono::nanoseconds idle{0};
+    for (const auto& s : mPool->stats()) {
+        active += s.active;
+        idle += s.idle;
+    }
+    size_t size = mPool->size();
+    // Workers come and go, and take their counters with them: only compare
+    // samples taken at the same size.
+    bool comparable = size == mSize && active >= mActive && idle >= mIdle;
+    auto busy = comparable ? active - mActive : std::chrono::nanoseconds(0);
+    auto total = comparable ? busy + (idle - mIdle) : std::chrono::nanoseconds(0);
+    mActive = active;
+    mIdle = idle;
+    mSize = size;
+
+    auto pending = mPool->pending();
+    // Without any time accounted for, the workers are either all asleep, or
+    // stuck in long tasks: tell them apart by whether tasks are waiting.
+    double load = total.count() > 0 ? double(busy.count()) / total.count() : (pending ? 1.0 : 0.0);
+
+    int change = 0;
+    if (size < mOptions.min) {
+        change = mOptions.min - size;
+    } else if (size > mOptions.max) {
+        change = -int(size - mOptions.max);
+    } else if (pending > 0 && load >= mOptions.grow && size < mOptions.max) {
+        change = std::min(mOptions.max - size, std::max<size_t>(1, size / 2));
+    } else if (pending == 0 && load <= mOptions.shrink && size > mOptions.min && mPool->idleworkers() > 0) {
+        change = -1;
+    }
+
+    for (int i = 0; i < change; ++i) mPool->addworker();
+    for (int i = 0; i > change; --i) {
+        if (!mPool->removeworker()) break;
+    }
+    return change;
+}
+
+void Autoscaler::loop() {
+    std::unique_lock<std::mutex> lk(mMutex);
+    while (!mStopped) {
+        mWakeup.wait_for(lk, mOptions.interval);
+        if (mStopped) break;
+        lk.unlock();
+        step();
+        lk.lock();
+    }
+}
@@ -0,0 +1,50 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/future.h>
+
+using namespace beehive;
+
+Continuations::Continuations(Pool* pool) : mPool(pool) {}
+
+Pool* Continuations::pool() const {
+    return mPool;
+}
+
+void Continuations::add(Task::Callable c) {
+    std::unique_lock<std::mutex> lk(mMutex);
+    if (!mReady) {
+        mCallbacks.emplace_back(std::move(c));
+        return;
+    }
+    lk.unlock();
+    c();
+}
+
+void Continuations::fire() {
+    std::vector<Task::Callable> callbacks;
+    {
+        std::unique_lock<std::mutex> lk(mMutex);
+        mReady = true;
+        callbacks.swap(mCallbacks);
+    }
+    for (auto& c : callbacks) c();
+}
+
+bool Continuations::ready() const {
+    std::unique_lock<std::mutex> lk(mMutex);
+    return mReady;
+}
@@ -0,0 +1,89 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/histogram.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace beehive;
+
+size_t Histogram::bucket(uint64_t v) {
+    if (v < SubBuckets) return v;
+    size_t shift = 63 - __builtin_clzll(v) - SubBits;
+    return (shift + 1) * SubBuckets + ((v >> shift) & (SubBuckets - 1));
+}
+
+uint64_t Histogram::lower(size_t b) {
+    if (b < SubBuckets) return b;
+    size_t shift = b / SubBuckets - 1;
+    return (SubBuckets + b % SubBuckets) << shift;
+}
+
+uint64_t Histogram::upper(size_t b) {
+    if (b < SubBuckets) return b;
+    size_t shift = b / SubBuckets - 1;
+    return lower(b) + ((uint64_t(1) << shift) - 1);
+}
+
+void Histogram::add(std::chrono::nanoseconds d, uint64_t n) {
+    mCounts[bucket(std::max<int64_t>(0, d.count()))] += n;
+    mCount += n;
+}
+
+void Histogram::merge(const Histogram& h) {
+    for (size_t b = 0; b < Buckets; ++b) mCounts[b] += h.mCounts[b];
+    mCount += h.mCount;
+}
+
+uint64_t Histogram::count() const {
+    return mCount;
+}
+
+uint64_t Histogram::count(size_t b) const {
+    return mCounts[b];
+}
+
+std::chrono::nanoseconds Histogram::quantile(double q) const {
+    if (mCount == 0) return std::chrono::nanoseconds(0);
+    // The rank of the value, from 1 to mCount.
+    auto rank = std::clamp<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * mCount), 1, mCount);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < Buckets; ++b) {
+        seen += mCounts[b];
+        if (seen >= rank) return std::chrono::nanoseconds(upper(b));
+    }
+    return max();
+}
+
+std::chrono::nanoseconds Histogram::max() const {
+    for (size_t b = Buckets; b > 0; --b) {
+        if (mCounts[b - 1]) return std::chrono::nanoseconds(upper(b - 1));
+    }
+    return std::chrono::nanoseconds(0);
+}
+
+void AtomicHistogram::add(std::chrono::nanoseconds d) {
+    auto& c = mCounts[Histogram::bucket(std::max<int64_t>(0, d.count()))];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void AtomicHistogram::addto(Histogram* h) const {
+    for (size_t b = 0; b < Histogram::Buckets; ++b) {
+        auto n = mCounts[b].load(std::memory_order_relaxed);
+        h->mCounts[b] += n;
+        h->mCount += n;
+    }
+}
@@ -0,0 +1,39 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/parker.h>
+#include <beehive/platform.h>
+
+using namespace beehive;
+
+Parker::Parker() : mState(EMPTY) {}
+
+void Parker::park() {
+    // NOTIFIED -> EMPTY consumes a pending token, EMPTY -> PARKED goes to sleep.
+    if (mState.fetch_sub(1, std::memory_order_acquire) == NOTIFIED) return;
+
+    while (true) {
+        Platform::wait(&mState, PARKED);
+        int expected = NOTIFIED;
+        if (mState.compare_exchange_strong(expected, EMPTY, std::memory_order_acquire)) return;
+    }
+}
+
+void Parker::unpark() {
+    if (mState.exchange(NOTIFIED, std::memory_order_release) == PARKED) {
+        Platform::wake(&mState);
+    }
+}
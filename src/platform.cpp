@@ -0,0 +1,72 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/platform.h>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <tuple>
+
+using namespace beehive;
+
+std::vector<size_t> Platform::placement(const Topology& t, Placement p) {
+    if (p == Placement::NONE) return {};
+
+    std::vector<Topology::Cpu> cpus;
+    std::copy_if(t.cpus.begin(), t.cpus.end(), std::back_inserter(cpus),
+                 [] (const Topology::Cpu& c) -> bool { return !c.isolated; });
+    if (cpus.empty()) cpus = t.cpus;
+
+    auto compact = [] (const Topology::Cpu& a, const Topology::Cpu& b) -> bool {
+        return std::tie(a.package, a.node, a.llc, a.core, a.id) < std::tie(b.package, b.node, b.llc, b.core, b.id);
+    };
+    std::sort(cpus.begin(), cpus.end(), compact);
+
+    if (p == Placement::CORES) {
+        auto last = std::unique(cpus.begin(), cpus.end(), [] (const Topology::Cpu& a, const Topology::Cpu& b) -> bool {
+            return a.core == b.core;
+        });
+        cpus.erase(last, cpus.end());
+    } else if (p == Placement::SCATTER) {
+        // Rank each CPU among the threads of its core, and each core among
+        // those of its package, then deal them out a package at a time.
+        struct Rank {
+            size_t thread;
+            size_t core;
+            size_t package;
+            size_t id;
+        };
+        std::vector<Rank> ranks;
+        std::map<size_t, size_t> threads;
+        std::map<size_t, size_t> cores;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            const auto& c = cpus[i];
+            auto thread = threads[c.core]++;
+            if (thread == 0) cores[c.package]++;
+            ranks.push_back(Rank{thread, cores[c.package] - 1, c.package, c.id});
+        }
+        std::sort(ranks.begin(), ranks.end(), [] (const Rank& a, const Rank& b) -> bool {
+            return std::tie(a.thread, a.core, a.package) < std::tie(b.thread, b.core, b.package);
+        });
+        std::vector<size_t> ids;
+        for (const auto& r : ranks) ids.push_back(r.id);
+        return ids;
+    }
+
+    std::vector<size_t> ids;
+    for (const auto& c : cpus) ids.push_back(c.id);
+    return ids;
+}
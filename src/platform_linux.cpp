@@ -18,11 +18,19 @@ limitations under the License.
 
 #include <beehive/platform.h>
 #include <sys/sysinfo.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <type_traits>
 #include <vector>
 
 static_assert(std::is_same_v<std::thread::native_handle_type, pthread_t>);
+static_assert(sizeof(std::atomic<int>) == sizeof(int));
 
 using namespace beehive;
 
@@ -30,6 +38,127 @@ size_t Platform::numprocessors() {
     return get_nprocs();
 }
 
+std::vector<size_t> Platform::cpulist(const std::string& s) {
+    std::vector<size_t> cpus;
+    size_t i = 0;
+    while (i < s.size()) {
+        size_t end = s.find(',', i);
+        if (end == std::string::npos) end = s.size();
+        auto range = s.substr(i, end - i);
+        i = end + 1;
+        auto dash = range.find('-');
+        try {
+            size_t first = std::stoul(range.substr(0, dash));
+            size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            for (auto c = first; c <= last; ++c) cpus.push_back(c);
+        } catch (const std::logic_error&) {
+            // Blank lines and stray whitespace.
+        }
+    }
+    return cpus;
+}
+
+namespace {
+std::string readline(const std::filesystem::path& p) {
+    std::ifstream f(p);
+    std::string line;
+    std::getline(f, line);
+    return line;
+}
+
+// The lowest CPU of a list, which serves as the id of the group it names.
+long leader(const std::filesystem::path& p, long fallback) {
+    auto cpus = Platform::cpulist(readline(p));
+    if (cpus.empty()) return fallback;
+    return *std::min_element(cpus.begin(), cpus.end());
+}
+
+long number(const std::filesystem::path& p, long fallback) {
+    try {
+        return std::stol(readline(p));
+    } catch (const std::logic_error&) {
+        return fallback;
+    }
+}
+
+// Renumbers raw keys densely, in the order they are first seen.
+struct Dense {
+    std::map<long, size_t> ids;
+
+    size_t operator()(long key) {
+        return ids.emplace(key, ids.size()).first->second;
+    }
+};
+}
+
+Topology Platform::topology(const std::string& root) {
+    namespace fs = std::filesystem;
+    const fs::path cpu = fs::path(root) / "cpu";
+    const fs::path node = fs::path(root) / "node";
+
+    auto online = cpulist(readline(cpu / "online"));
+    if (online.empty()) {
+        for (size_t i = 0; i < numprocessors(); ++i) online.push_back(i);
+    }
+
+    std::map<size_t, long> nodes;
+    std::error_code ec;
+    for (const auto& e : fs::directory_iterator(node, ec)) {
+        auto name = e.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4) continue;
+        if (!std::all_of(name.begin() + 4, name.end(), ::isdigit)) continue;
+        for (auto c : cpulist(readline(e.path() / "cpulist"))) nodes[c] = std::stol(name.substr(4));
+    }
+
+    std::vector<bool> isolated;
+    for (auto list : {"isolated", "nohz_full"}) {
+        for (auto c : cpulist(readline(cpu / list))) {
+            if (c >= isolated.size()) isolated.resize(c + 1);
+            isolated[c] = true;
+        }
+    }
+
+    Topology t;
+    Dense packages, numa, llcs, cores;
+    for (auto id : online) {
+        auto dir = cpu / ("cpu" + std::to_string(id));
+        long package = number(dir / "topology" / "physical_package_id", 0);
+        long core = leader(dir / "topology" / "thread_siblings_list", id);
+
+        // The highest level data cache, and failing that the package.
+        long llc = -1 - package;
+        long level = 0;
+        for (int i = 0; fs::exists(dir / "cache" / ("index" + std::to_string(i))); ++i) {
+            auto index = dir / "cache" / ("index" + std::to_string(i));
+            if (readline(index / "type") == "Instruction") continue;
+            auto l = number(index / "level", 0);
+            if (l < level) continue;
+            level = l;
+            llc = leader(index / "shared_cpu_list", id);
+        }
+
+        auto n = nodes.find(id);
+        t.cpus.push_back(Topology::Cpu{
+            id,
+            packages(package),
+            numa(n == nodes.end() ? 0 : n->second),
+            llcs(llc),
+            cores(core),
+            id < isolated.size() && isolated[id],
+        });
+    }
+    t.packages = packages.ids.size();
+    t.nodes = numa.ids.size();
+    t.llcs = llcs.ids.size();
+    t.cores = cores.ids.size();
+    return t;
+}
+
+const Topology& Platform::topology() {
+    static const Topology t = topology("/sys/devices/system");
+    return t;
+}
+
 std::vector<bool> Platform::affinity(std::thread::native_handle_type nh) {
     std::vector<bool> ret;
 
@@ -64,4 +193,20 @@ void Platform::name(std::thread::native_handle_type nh, const char* s) {
     pthread_setname_np(nh, s);
 }
 
+void Platform::relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+void Platform::wait(std::atomic<int>* addr, int expected) {
+    syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void Platform::wake(std::atomic<int>* addr, int n) {
+    syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+}
+
 #endif
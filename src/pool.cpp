@@ -15,18 +15,119 @@ limitations under the License.
 */
 
 #include <beehive/pool.h>
+#include <beehive/recycler.h>
 #include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <type_traits>
 
 using namespace beehive;
 
-Pool::Pool(size_t num) {
+Pool::Pool(size_t num) : Pool(num, Options{}) {}
+
+Pool::Pool(size_t num, const Options& opts) :
+    mOptions(opts),
+    mTimers([this] (Task::Callable c, Task::Priority p) -> void { schedule(std::move(c), p); },
+            std::chrono::milliseconds(1), opts.timerSlack) {
+    layout();
+    for (size_t d = 0; d < mDomains.size(); ++d) {
+        auto& q = mTasks.emplace_back();
+        if (mOptions.queue == Queue::DEADLINE) q.emplace<DeadlineQueue>();
+        else if (mOptions.queue == Queue::BUCKETS || mOptions.aging.count() > 0) q.emplace<BucketsQueue>();
+    }
+    for (auto& w : mMaxWait) w.store(-1, std::memory_order_relaxed);
+    if (mOptions.tracing) mTrace = std::make_unique<TraceBuffer>(mOptions.tracing);
     if (num == 0) num = std::thread::hardware_concurrency();
+    if (num > MaxWorkers) num = MaxWorkers;
     for(int i = 0; i < num; ++i) {
-        mWorkers.emplace_back(std::make_unique<Worker>(this, i));
+        addworker();
     }
 }
 
-Pool::~Pool() = default;
+// Splits the pool in domains, works out how far apart they are, and which
+// CPUs their workers go to.
+void Pool::layout() {
+    if (mOptions.layout == Layout::FLAT && mOptions.placement == Placement::NONE) {
+        mDomains.resize(1);
+        mDomains[0].order = {0};
+        mDomains[0].workers.fill(~uint64_t(0));
+        return;
+    }
+
+    const auto& topo = Platform::topology();
+    auto key = [this] (const Topology::Cpu& c) -> size_t {
+        switch (mOptions.layout) {
+            case Layout::LLC: return c.llc;
+            case Layout::NUMA: return c.node;
+            default: return 0;
+        }
+    };
+    size_t n = 1;
+    if (mOptions.layout == Layout::LLC) n = std::max<size_t>(1, topo.llcs);
+    if (mOptions.layout == Layout::NUMA) n = std::max<size_t>(1, topo.nodes);
+    size_t ncpus = 0;
+    for (const auto& c : topo.cpus) ncpus = std::max(ncpus, c.id + 1);
+    std::vector<const Topology::Cpu*> byid(ncpus, nullptr);
+    for (const auto& c : topo.cpus) byid[c.id] = &c;
+
+    // Workers keep off isolated CPUs, unless there is nothing else.
+    bool isolated = std::all_of(topo.cpus.begin(), topo.cpus.end(), [] (const Topology::Cpu& c) -> bool {
+        return c.isolated;
+    });
+    mDomains.resize(n);
+    std::vector<const Topology::Cpu*> first(n, nullptr);
+    for (const auto& c : topo.cpus) {
+        if (!first[key(c)]) first[key(c)] = &c;
+        if (c.isolated && !isolated) continue;
+        auto& d = mDomains[key(c)];
+        if (d.cpus.empty()) d.cpus.resize(ncpus);
+        d.cpus[c.id] = true;
+    }
+    for (auto id : Platform::placement(topo, mOptions.placement)) {
+        mDomains[key(*byid[id])].placed.push_back(id);
+    }
+    for (size_t i = 0; i < MaxWorkers; ++i) {
+        mDomains[i % n].workers[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    // Caches on the same node, then on the same package, then the rest.
+    auto distance = [&first] (size_t a, size_t b) -> int {
+        if (a == b) return 0;
+        if (!first[a] || !first[b]) return 3;
+        if (first[a]->node == first[b]->node) return 1;
+        if (first[a]->package == first[b]->package) return 2;
+        return 3;
+    };
+    for (size_t a = 0; a < n; ++a) {
+        auto& order = mDomains[a].order;
+        for (size_t b = 0; b < n; ++b) order.push_back(b);
+        std::stable_sort(order.begin(), order.end(), [&] (size_t x, size_t y) -> bool {
+            return distance(a, x) < distance(a, y);
+        });
+    }
+}
+
+// The CPUs a worker gets pinned to, by id: the next one placed in its
+// domain, or the whole domain. Empty when workers are not pinned.
+std::vector<bool> Pool::cpus(size_t id) const {
+    const auto& d = mDomains[domain(id)];
+    if (d.placed.empty()) return mOptions.layout == Layout::FLAT ? std::vector<bool>() : d.cpus;
+    auto cpu = d.placed[(id / mDomains.size()) % d.placed.size()];
+    std::vector<bool> mask(cpu + 1);
+    mask[cpu] = true;
+    return mask;
+}
+
+Pool::~Pool() {
+    mTimers.stop();
+    // Stop every worker before any of them, or the queues they are reading
+    // from, are destroyed: a running worker may still wake its siblings.
+    foreachworker([] (std::unique_ptr<Worker>& w) -> void { w->exit(); });
+    foreachworker([] (std::unique_ptr<Worker>& w) -> void { w->join(); });
+    std::unique_lock<std::mutex> resize(mResizeMutex);
+    reap(true);
+}
 
 void Pool::foreachworker(std::function<void(std::unique_ptr<Worker>&)> f) {
     std::unique_lock<std::recursive_mutex> lkk(mWorkersMutex);
@@ -47,14 +148,99 @@ size_t Pool::size() const {
 }
 
 std::shared_future<void> Pool::schedule(Task::Callable c, Task::Priority p) {
-    auto tsk = std::make_shared<Task>(c);
-    mTasks.push(p, tsk);
-    foreachworker([] (std::unique_ptr<Worker>& wb) -> void {
-        wb->task();
-    });
+    auto tsk = std::allocate_shared<Task>(RecyclingAllocator<Task>(), std::move(c));
+    wake(1, enqueue(p, tsk));
+    return tsk->future();
+}
+
+std::shared_future<void> Pool::schedule(Task::Callable c, Task::Clock::time_point deadline, Task::Priority p) {
+    auto tsk = std::allocate_shared<Task>(RecyclingAllocator<Task>(), std::move(c));
+    tsk->deadline(deadline);
+    wake(1, enqueue(p, tsk));
+    return tsk->future();
+}
+
+std::shared_future<void> Pool::schedule(Task::Callable c, Domain d, Task::Priority p) {
+    auto tsk = std::allocate_shared<Task>(RecyclingAllocator<Task>(), std::move(c));
+    wake(1, enqueue(p, tsk, d.id % mDomains.size()));
     return tsk->future();
 }
 
+void Pool::post(Task::Callable c, Task::Priority p) {
+    wake(1, enqueue(p, std::allocate_shared<Task>(RecyclingAllocator<Task>(), std::move(c), Task::Detached{})));
+}
+
+TimerWheel::Timer Pool::scheduleAfter(Task::Clock::duration d, Task::Callable c, Task::Priority p) {
+    return mTimers.add(Task::Clock::now() + d, std::move(c), p);
+}
+
+TimerWheel::Timer Pool::scheduleAt(Task::Clock::time_point t, Task::Callable c, Task::Priority p) {
+    return mTimers.add(t, std::move(c), p);
+}
+
+TimerWheel::Timer Pool::schedulePeriodic(Task::Clock::duration interval, Task::Callable c, Task::Priority p) {
+    return mTimers.add(Task::Clock::now() + interval, interval, std::move(c), p);
+}
+
+Pool::Resume Pool::schedule_on(Task::Priority p) {
+    return Resume{this, p};
+}
+
+std::shared_future<void> Pool::schedule(Task::Callable c, std::stop_token token, Task::Priority p) {
+    auto tsk = std::allocate_shared<Task>(RecyclingAllocator<Task>(), std::move(c));
+    if (token.stop_possible()) tsk->cancellable(std::move(token));
+    wake(1, enqueue(p, tsk));
+    return tsk->future();
+}
+
+std::vector<std::shared_future<void>> Pool::scheduleBatch(std::vector<Task::Callable> cs, Task::Priority p) {
+    return scheduleBatch(std::move(cs), std::stop_token(), p);
+}
+
+std::vector<std::shared_future<void>> Pool::scheduleBatch(std::vector<Task::Callable> cs, std::stop_token token,
+                                                          Task::Priority p) {
+    Tasks tsks;
+    std::vector<std::shared_future<void>> futures;
+    tsks.reserve(cs.size());
+    futures.reserve(cs.size());
+    for (auto& c : cs) {
+        tsks.emplace_back(std::allocate_shared<Task>(RecyclingAllocator<Task>(), std::move(c)));
+        if (token.stop_possible()) tsks.back()->cancellable(token);
+        futures.emplace_back(tsks.back()->future());
+    }
+    auto n = tsks.size();
+    wake(n, enqueue(p, std::move(tsks)));
+    return futures;
+}
+
+// Pairs with park(): either the parking worker sees the new task, or we see
+// the worker parked. All the operations involved are sequentially consistent.
+void Pool::wake(size_t n, size_t domain) {
+    while (n > 0) {
+        auto id = mDomains.size() > 1 ? mParked.claim(mDomains[domain].workers) : std::nullopt;
+        if (!id) id = mParked.claim();
+        if (!id) return;
+        mWaking.fetch_add(1);
+        // Null for a worker that is being removed: try another one.
+        if (auto wk = mWorkerIds[*id].load()) {
+            wk->task();
+            --n;
+        }
+        mWaking.fetch_sub(1);
+    }
+}
+
+bool Pool::park(int id) {
+    mParked.set(id);
+    if (idle()) return true;
+    // If somebody else cleared the bit first, a TASK message is on its way.
+    return !mParked.clear(id);
+}
+
+size_t Pool::idleworkers() const {
+    return mParked.count();
+}
+
 std::vector<Worker::Stats> Pool::stats() {
     std::vector<Worker::Stats> s;
     foreachworker([&s] (std::unique_ptr<Worker>& wb) -> void {
@@ -63,6 +249,20 @@ std::vector<Worker::Stats> Pool::stats() {
     return s;
 }
 
+std::vector<Pool::Latency> Pool::latency() {
+    std::vector<Latency> l(Task::Bands);
+    constexpr size_t width = (Task::MaxPriority + 1) / Task::Bands;
+    for (size_t b = 0; b < Task::Bands; ++b) {
+        l[b].lowest = b * width;
+        l[b].highest = (b + 1) * width - 1;
+        l[b].depth = std::max<int64_t>(0, mDepth[b].load(std::memory_order_relaxed));
+    }
+    foreachworker([&l] (std::unique_ptr<Worker>& wk) -> void {
+        for (size_t b = 0; b < Task::Bands; ++b) wk->latency(b, &l[b].wait, &l[b].run);
+    });
+    return l;
+}
+
 Worker::View Pool::worker(int i) {
     std::unique_lock<std::recursive_mutex> lkk(mWorkersMutex);
 
@@ -73,13 +273,238 @@ Worker::View Pool::worker(int i) {
     }
 }
 
+size_t Pool::domains() const {
+    return mDomains.size();
+}
+
+size_t Pool::domain(int id) const {
+    return id % mDomains.size();
+}
+
+// The domain new tasks go to by default: the calling worker's own one, or
+// the next one in turn for threads outside of the pool.
+size_t Pool::home() {
+    auto wk = Worker::current();
+    if (wk && wk->pool() == this) return domain(wk->id());
+    if (mDomains.size() == 1) return 0;
+    return mNextDomain.fetch_add(1, std::memory_order_relaxed) % mDomains.size();
+}
+
+// In STEALING mode, the deque new tasks should go to: the calling worker's
+// own one, or the next one in turn, within the domain, for threads outside
+// of the pool or tasks meant for another domain.
+size_t Pool::target(size_t d) {
+    auto wk = Worker::current();
+    if (wk && wk->pool() == this && domain(wk->id()) == d) return wk->id();
+    auto n = mNumDeques.load();
+    auto nd = mDomains.size();
+    if (d >= n) return mNextDeque.fetch_add(1) % n;
+    // Deques d, d + nd, d + 2 * nd... belong to the domain.
+    return d + nd * (mNextDeque.fetch_add(1) % ((n - d + nd - 1) / nd));
+}
+
+size_t Pool::enqueue(Task::Priority p, std::shared_ptr<Task> tsk, std::optional<size_t> domain) {
+    auto d = domain ? *domain : home();
+    mDepth[Task::band(accounted(p))].fetch_add(1, std::memory_order_relaxed);
+    if (mOptions.tracing) traced(TraceBuffer::Event::ENQUEUE, *tsk, p);
+    tsk->enqueued(std::chrono::steady_clock::now());
+    if (mOptions.scheduling == Scheduling::STEALING) {
+        mDeques[target(d)].load()->push(p, tsk);
+    } else {
+        std::visit([p, &tsk] (auto& q) -> void {
+            if constexpr (std::is_same_v<std::decay_t<decltype(q)>, DeadlineQueue>) {
+                auto d = tsk->deadline();
+                q.push(d, std::move(tsk));
+            } else {
+                q.push(p, std::move(tsk));
+            }
+        }, mTasks[d]);
+    }
+    return d;
+}
+
+size_t Pool::enqueue(Task::Priority p, Tasks&& tsks) {
+    auto d = home();
+    mDepth[Task::band(accounted(p))].fetch_add(tsks.size(), std::memory_order_relaxed);
+    if (mOptions.tracing) {
+        for (const auto& tsk : tsks) traced(TraceBuffer::Event::ENQUEUE, *tsk, p);
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (auto& tsk : tsks) tsk->enqueued(now);
+    auto begin = std::make_move_iterator(tsks.begin());
+    auto end = std::make_move_iterator(tsks.end());
+    if (mOptions.scheduling == Scheduling::STEALING) {
+        mDeques[target(d)].load()->push(p, begin, end);
+    } else {
+        std::visit([p, begin, end] (auto& q) -> void {
+            if constexpr (std::is_same_v<std::decay_t<decltype(q)>, DeadlineQueue>) {
+                for (auto it = begin; it != end; ++it) {
+                    std::shared_ptr<Task> tsk = *it;
+                    auto d = tsk->deadline();
+                    q.push(d, std::move(tsk));
+                }
+            } else {
+                q.push(p, begin, end);
+            }
+        }, mTasks[d]);
+    }
+    return d;
+}
+
 bool Pool::idle() const {
-    return mTasks.empty();
+    if (mOptions.scheduling == Scheduling::STEALING) {
+        auto n = mNumDeques.load();
+        for (size_t i = 0; i < n; ++i) {
+            if (!mDeques[i].load()->empty()) return false;
+        }
+        return true;
+    }
+    for (const auto& tasks : mTasks) {
+        if (!std::visit([] (const auto& q) -> bool { return q.empty(); }, tasks)) return false;
+    }
+    return true;
 }
 
-std::shared_ptr<Task> Pool::task() {
-    auto tsk = mTasks.trypop();
-    return tsk.value_or(nullptr);
+size_t Pool::pending() const {
+    if (mOptions.scheduling == Scheduling::STEALING) {
+        size_t n = 0;
+        auto d = mNumDeques.load();
+        for (size_t i = 0; i < d; ++i) n += mDeques[i].load()->size();
+        return n;
+    }
+    size_t n = 0;
+    for (const auto& tasks : mTasks) n += std::visit([] (const auto& q) -> size_t { return q.size(); }, tasks);
+    return n;
+}
+
+std::shared_ptr<Task> Pool::task(Task::Priority* priority) {
+    Task::Priority p = Task::DefaultPriority;
+    std::shared_ptr<Task> tsk;
+    if (mOptions.scheduling == Scheduling::STEALING) {
+        tsk = steal(&p);
+    } else {
+        auto wk = Worker::current();
+        size_t self = (wk && wk->pool() == this) ? domain(wk->id()) : 0;
+        for (auto d : mDomains[self].order) {
+            if ((tsk = trypop(mTasks[d], &p))) break;
+        }
+    }
+    if (tsk) {
+        mDepth[Task::band(p)].fetch_sub(1, std::memory_order_relaxed);
+        waited(p, *tsk);
+    }
+    if (priority) *priority = p;
+    return tsk;
+}
+
+std::shared_ptr<Task> Pool::trypop(SharedQueue& tasks, Task::Priority* p) {
+    // Aging only applies to the BUCKETS queue, which the DEADLINE one takes
+    // precedence over.
+    if (auto aging = mOptions.aging.count(); aging > 0 && std::holds_alternative<BucketsQueue>(tasks)) {
+        auto now = std::chrono::steady_clock::now();
+        auto rank = [now, aging] (Task::Priority k, const std::shared_ptr<Task>& t) -> int64_t {
+            return k + std::chrono::nanoseconds(now - t->enqueued()).count() / aging;
+        };
+        return std::get<BucketsQueue>(tasks).trypop(p, rank).value_or(nullptr);
+    }
+    return std::visit([p] (auto& q) -> std::shared_ptr<Task> {
+        if constexpr (std::is_same_v<std::decay_t<decltype(q)>, DeadlineQueue>) {
+            return q.trypop().value_or(nullptr);
+        } else {
+            return q.trypop(p).value_or(nullptr);
+        }
+    }, tasks);
+}
+
+Task::Priority Pool::accounted(Task::Priority p) const {
+    bool deadlines = mOptions.scheduling == Scheduling::SHARED && mOptions.queue == Queue::DEADLINE;
+    return deadlines ? Task::DefaultPriority : p;
+}
+
+void Pool::waited(Task::Priority p, const Task& tsk) {
+    auto ns = std::chrono::nanoseconds(std::chrono::steady_clock::now() - tsk.enqueued()).count();
+    auto& longest = mMaxWait[p];
+    auto cur = longest.load(std::memory_order_relaxed);
+    while (ns > cur && !longest.compare_exchange_weak(cur, ns, std::memory_order_relaxed)) {}
+}
+
+std::map<Task::Priority, std::chrono::nanoseconds> Pool::waits() const {
+    std::map<Task::Priority, std::chrono::nanoseconds> w;
+    for (size_t p = 0; p < mMaxWait.size(); ++p) {
+        auto ns = mMaxWait[p].load(std::memory_order_relaxed);
+        if (ns >= 0) w.emplace(p, std::chrono::nanoseconds(ns));
+    }
+    return w;
+}
+
+// Takes the highest priority task across all deques, preferring the calling
+// worker's own deque when there is a tie. Thieves start scanning right after
+// themselves so that they do not all converge on the same victim. With more
+// than one domain, workers only steal across domains when theirs is empty.
+std::shared_ptr<Task> Pool::steal(Task::Priority* p) {
+    auto wk = Worker::current();
+    auto n = mNumDeques.load();
+    size_t self = (wk && wk->pool() == this) ? wk->id() : n;
+    bool local = self < n && mDomains.size() > 1;
+
+    while (true) {
+        Deque* best = nullptr;
+        Task::Priority bestp = Task::MinPriority;
+        if (self < n) {
+            auto d = mDeques[self].load();
+            if (auto p = d->top()) {
+                best = d;
+                bestp = *p;
+            }
+        }
+        for (size_t j = 1; j <= n; ++j) {
+            auto i = (self + j) % n;
+            if (i == self || (local && domain(i) != domain(self))) continue;
+            auto d = mDeques[i].load();
+            auto p = d->top();
+            if (p && (best == nullptr || *p > bestp)) {
+                best = d;
+                bestp = *p;
+            }
+        }
+        if (best == nullptr) {
+            if (!local) return nullptr;
+            local = false;
+            continue;
+        }
+
+        auto tsk = (self < n && best == mDeques[self].load()) ? best->pop(p) : best->steal(p);
+        if (tsk) return *tsk;
+    }
+}
+
+// Workers write to their own buffer, and everybody else to the shared one.
+void Pool::traced(TraceBuffer::Event e, const Task& tsk, Task::Priority p) {
+    auto id = reinterpret_cast<uintptr_t>(&tsk);
+    auto wk = Worker::current();
+    if (wk && wk->pool() == this) {
+        wk->trace()->add(e, id, p);
+    } else {
+        std::unique_lock<std::mutex> lk(mTraceMutex);
+        mTrace->add(e, id, p);
+    }
+}
+
+bool Pool::dumpTrace(const std::string& path) {
+    if (!mTrace) return false;
+    std::vector<TraceTrack> tracks;
+    foreachworker([&tracks] (std::unique_ptr<Worker>& wk) -> void {
+        tracks.push_back(TraceTrack{wk->id(), wk->name(), wk->trace()->records()});
+    });
+    {
+        std::unique_lock<std::mutex> lk(mTraceMutex);
+        tracks.push_back(TraceTrack{int(MaxWorkers), "outside", mTrace->records()});
+    }
+
+    std::ofstream f(path);
+    writeChromeTrace(f, tracks);
+    f.close();
+    return bool(f);
 }
 
 void Pool::dump() {
@@ -89,12 +514,71 @@ void Pool::dump() {
 }
 
 void Pool::addworker() {
+    std::unique_lock<std::mutex> resize(mResizeMutex);
+    reap(false);
     std::unique_lock<std::recursive_mutex> lkk(mWorkersMutex);
 
     auto i = mWorkers.size();
+    if (i >= MaxWorkers) return;
+    if (mOptions.scheduling == Scheduling::STEALING && i >= mDequeStore.size()) {
+        mDequeStore.emplace_back(std::make_unique<Deque>());
+        mDeques[i].store(mDequeStore.back().get());
+        mNumDeques.store(mDequeStore.size());
+    }
     mWorkers.emplace_back(std::make_unique<Worker>(this, i));
+    if (auto mask = cpus(i); !mask.empty()) mWorkers.back()->affinity(mask);
+    mWorkerIds[i].store(mWorkers.back().get());
+    if (!park(i)) mWorkers.back()->task();
+}
+
+bool Pool::removeworker() {
+    std::unique_lock<std::mutex> resize(mResizeMutex);
+    std::unique_ptr<Worker> victim;
+    {
+        std::unique_lock<std::recursive_mutex> lkk(mWorkersMutex);
+        if (mWorkers.size() <= 1 || mWorkers.back().get() == Worker::current()) return false;
+        victim = std::move(mWorkers.back());
+        mWorkers.pop_back();
+    }
+
+    // Unpublish the worker, so that no new wakeups go to it. It may be in
+    // the middle of a long task: rather than wait for it, leave it to finish
+    // on its own, and delete it on a later call.
+    auto id = victim->id();
+    mWorkerIds[id].store(nullptr);
+    victim->retire();
+    mParked.clear(id);
+    mRetired.push_back(std::move(victim));
+    reap(false);
+
+    // The worker may have been woken for tasks it will never run, or left
+    // some in its deque.
+    if (!idle()) wake(pending(), domain(id));
+    return true;
+}
+
+void Pool::reap(bool wait) {
+    auto done = [wait] (const std::unique_ptr<Worker>& w) -> bool { return wait || w->finished(); };
+    auto it = std::partition(mRetired.begin(), mRetired.end(), [&done] (const auto& w) -> bool {
+        return !done(w);
+    });
+    if (it == mRetired.end()) return;
+    for (auto w = it; w != mRetired.end(); ++w) {
+        (*w)->join();
+        // The worker may have parked again after it was unpublished. Its id
+        // is not ours to clear if a new worker took it since.
+        if (!mWorkerIds[(*w)->id()].load()) mParked.clear((*w)->id());
+    }
+    // Wakers that picked a worker before it was unpublished may still be
+    // using it.
+    while (mWaking.load() != 0) std::this_thread::yield();
+    mRetired.erase(it, mRetired.end());
 }
 
 IdempotencySet& Pool::idempotency() {
     return mIdempotencySet;
 }
+
+const Pool::Options& Pool::options() const {
+    return mOptions;
+}
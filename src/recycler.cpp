@@ -0,0 +1,168 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/recycler.h>
+#include <atomic>
+
+using namespace beehive;
+
+namespace {
+// Size classes are powers of two, from 32 bytes up to Recycler::MaxSize.
+constexpr size_t MinShift = 5;
+constexpr size_t NumClasses = 5;
+static_assert((size_t(1) << (MinShift + NumClasses - 1)) == Recycler::MaxSize);
+
+// A free list holding more than this many blocks returns the excess to the heap.
+constexpr size_t MaxCached = 4096;
+
+struct Heap;
+
+// Every block starts with a header naming the heap it belongs to. The header
+// is as large as max_align_t so that the payload stays suitably aligned.
+struct alignas(std::max_align_t) Block {
+    Heap* owner;
+    Block* next;
+};
+
+struct Heap {
+    // Only ever touched by the thread that owns the heap.
+    Block* local[NumClasses] = {};
+    size_t cached[NumClasses] = {};
+    // Blocks freed by other threads, pushed without locks, and taken all
+    // at once by the owner.
+    std::atomic<Block*> remote[NumClasses] = {};
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    std::atomic<bool> inuse{true};
+    Heap* next = nullptr;
+};
+
+// Heaps are never freed. When a thread exits its heap is handed over to the
+// next thread that needs one, along with any block still on its way back.
+std::atomic<Heap*> gHeaps{nullptr};
+
+Heap* acquire() {
+    for (Heap* h = gHeaps.load(); h; h = h->next) {
+        bool expected = false;
+        if (h->inuse.compare_exchange_strong(expected, true)) return h;
+    }
+    Heap* h = new Heap();
+    h->next = gHeaps.load();
+    while (!gHeaps.compare_exchange_weak(h->next, h));
+    return h;
+}
+
+thread_local Heap* tHeap = nullptr;
+
+// Gives the heap back when the thread exits. Should anything be freed later
+// on during thread teardown, the thread just gets a new heap, which it keeps.
+struct HeapRef {
+    ~HeapRef() {
+        if (tHeap) tHeap->inuse.store(false);
+        tHeap = nullptr;
+    }
+};
+
+Heap* thisheap() {
+    if (tHeap == nullptr) {
+        tHeap = acquire();
+        static thread_local HeapRef tRef;
+    }
+    return tHeap;
+}
+
+size_t classof(size_t n) {
+    size_t c = 0;
+    while ((size_t(1) << (MinShift + c)) < n) ++c;
+    return c;
+}
+
+size_t blocksize(size_t c) {
+    return sizeof(Block) + (size_t(1) << (MinShift + c));
+}
+
+void release(Block* b) {
+    ::operator delete(b);
+}
+
+void push(Heap* h, size_t c, Block* b) {
+    if (h->cached[c] >= MaxCached) {
+        release(b);
+        return;
+    }
+    b->next = h->local[c];
+    h->local[c] = b;
+    ++h->cached[c];
+}
+
+// Moves whatever other threads gave back onto the local free list.
+void reclaim(Heap* h, size_t c) {
+    Block* b = h->remote[c].exchange(nullptr, std::memory_order_acquire);
+    while (b) {
+        Block* next = b->next;
+        push(h, c, b);
+        b = next;
+    }
+}
+}
+
+void* Recycler::allocate(size_t n) {
+    if (n > MaxSize) return ::operator new(n);
+
+    auto c = classof(n);
+    Heap* h = thisheap();
+    if (h->local[c] == nullptr) reclaim(h, c);
+
+    Block* b = h->local[c];
+    if (b) {
+        h->local[c] = b->next;
+        --h->cached[c];
+        h->hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        b = static_cast<Block*>(::operator new(blocksize(c)));
+        b->owner = h;
+        h->misses.fetch_add(1, std::memory_order_relaxed);
+    }
+    return b + 1;
+}
+
+void Recycler::deallocate(void* p, size_t n) {
+    if (n > MaxSize) {
+        ::operator delete(p);
+        return;
+    }
+
+    auto c = classof(n);
+    Block* b = static_cast<Block*>(p) - 1;
+    Heap* owner = b->owner;
+    if (owner == thisheap()) {
+        push(owner, c, b);
+    } else {
+        b->next = owner->remote[c].load(std::memory_order_relaxed);
+        while (!owner->remote[c].compare_exchange_weak(b->next, b, std::memory_order_release));
+    }
+}
+
+Recycler::Stats Recycler::stats() {
+    Stats s{0, 0};
+    for (Heap* h = gHeaps.load(); h; h = h->next) {
+        s.hits += h->hits.load(std::memory_order_relaxed);
+        s.misses += h->misses.load(std::memory_order_relaxed);
+    }
+    return s;
+}
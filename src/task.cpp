@@ -15,18 +15,67 @@ limitations under the License.
 */
 
 #include <beehive/task.h>
+#include <beehive/recycler.h>
 
 using namespace beehive;
 
-Task::Task(Callable c) : mCallable(c), mPromise() {
-    mFuture = mPromise.get_future();
+Task::Task(Callable c) : mCallable(std::move(c)) {
+    mPromise.emplace(std::allocator_arg, RecyclingAllocator<char>());
+    mFuture = mPromise->get_future();
 }
 
+Task::Task(Callable c, Detached) : mCallable(std::move(c)) {}
+
 std::shared_future<void>& Task::future() {
     return mFuture;
 }
 
+Task::Clock::time_point Task::deadline() const {
+    return mDeadline;
+}
+
+void Task::deadline(Clock::time_point d) {
+    mDeadline = d;
+}
+
+std::chrono::steady_clock::time_point Task::enqueued() const {
+    return mEnqueued;
+}
+
+void Task::enqueued(std::chrono::steady_clock::time_point t) {
+    mEnqueued = t;
+}
+
+void Task::cancellable(std::stop_token token) {
+    mOnStop.emplace(std::move(token), OnStop{this});
+}
+
+bool Task::start() {
+    return !mOnStop || !mStarted.exchange(true);
+}
+
+void Task::cancel() {
+    if (mStarted.exchange(true)) return;
+    // Let go of whatever the callable holds now, rather than when the task
+    // eventually gets dequeued.
+    mCallable = Callable();
+    if (mPromise) mPromise->set_exception(std::make_exception_ptr(TaskCancelled()));
+}
+
 void Task::run() {
-    mCallable();
-    mPromise.set_value();
+    if (!start()) return;
+    if (mDeadline != NoDeadline && Clock::now() > mDeadline) {
+        if (mPromise) mPromise->set_exception(std::make_exception_ptr(DeadlineExceeded()));
+        return;
+    }
+    if (!mPromise) {
+        mCallable();
+        return;
+    }
+    try {
+        mCallable();
+        mPromise->set_value();
+    } catch (...) {
+        mPromise->set_exception(std::current_exception());
+    }
 }
@@ -0,0 +1,261 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/timer.h>
+#include <beehive/platform.h>
+#include <algorithm>
+#include <bit>
+
+using namespace beehive;
+
+class TimerWheel::Entry {
+    public:
+        enum class State {
+            // Waiting in the wheel.
+            ARMED,
+            // A periodic timer that is being run, and will be armed again.
+            FIRING,
+            CANCELLED,
+            DONE,
+        };
+
+        TimerWheel* wheel;
+        uint64_t expiry;
+        // In ticks, or 0 for timers that only run once.
+        uint64_t interval;
+        Task::Callable fn;
+        Task::Priority priority;
+
+        // The rest is guarded by the wheel's mutex.
+        State state = State::ARMED;
+        size_t level = 0;
+        size_t slot = 0;
+        Slot::iterator pos;
+};
+
+TimerWheel::Timer::Timer(std::shared_ptr<Entry> e) : mEntry(std::move(e)) {}
+
+bool TimerWheel::Timer::cancel() {
+    if (!mEntry) return false;
+    auto wheel = mEntry->wheel;
+    std::unique_lock<std::mutex> lk(wheel->mMutex);
+    switch (mEntry->state) {
+        case Entry::State::ARMED:
+            wheel->unlink(*mEntry);
+            mEntry->state = Entry::State::CANCELLED;
+            return true;
+        case Entry::State::FIRING:
+            mEntry->state = Entry::State::CANCELLED;
+            return true;
+        default:
+            return false;
+    }
+}
+
+TimerWheel::Timer::operator bool() const {
+    return mEntry != nullptr;
+}
+
+TimerWheel::TimerWheel(Dispatch d, Clock::duration tick, Clock::duration slack) :
+    mDispatch(std::move(d)), mTick(std::max(tick, Clock::duration(1))),
+    mSlack(std::max<uint64_t>(1, (slack + mTick - Clock::duration(1)) / mTick)),
+    mEpoch(Clock::now()) {}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+TimerWheel::Timer TimerWheel::add(Clock::time_point when, Task::Callable f, Task::Priority p) {
+    return add(when, Clock::duration::zero(), std::move(f), p);
+}
+
+TimerWheel::Timer TimerWheel::add(Clock::time_point when, Clock::duration interval, Task::Callable f,
+                                  Task::Priority p) {
+    auto e = std::make_shared<Entry>();
+    e->wheel = this;
+    e->interval = interval > Clock::duration::zero() ? std::max<uint64_t>(1, (interval + mTick - Clock::duration(1)) / mTick) : 0;
+    e->fn = std::move(f);
+    e->priority = p;
+
+    std::unique_lock<std::mutex> lk(mMutex);
+    if (mStopped) {
+        e->state = Entry::State::CANCELLED;
+        return Timer(e);
+    }
+    if (!mThread.joinable()) {
+        mThread = std::thread(&TimerWheel::loop, this);
+        Platform::name(mThread.native_handle(), "beehive-timer");
+    }
+    e->expiry = std::max(tickof(when), mNow + 1);
+    e->expiry = (e->expiry + mSlack - 1) / mSlack * mSlack;
+    insert(e);
+    if (e->expiry < mNextWake) mWakeup.notify_one();
+    return Timer(e);
+}
+
+size_t TimerWheel::size() const {
+    std::unique_lock<std::mutex> lk(mMutex);
+    return mSize;
+}
+
+void TimerWheel::stop() {
+    {
+        std::unique_lock<std::mutex> lk(mMutex);
+        mStopped = true;
+        for (auto& level : mSlots) {
+            for (auto& slot : level) {
+                for (auto& e : slot) e->state = Entry::State::CANCELLED;
+                slot.clear();
+            }
+        }
+        mOccupied.fill(0);
+        mSize = 0;
+    }
+    mWakeup.notify_one();
+    if (mThread.joinable()) mThread.join();
+}
+
+uint64_t TimerWheel::tickof(Clock::time_point t) const {
+    if (t <= mEpoch) return 0;
+    return (t - mEpoch + mTick - Clock::duration(1)) / mTick;
+}
+
+TimerWheel::Clock::time_point TimerWheel::timeof(uint64_t tick) const {
+    return mEpoch + tick * mTick;
+}
+
+void TimerWheel::insert(const std::shared_ptr<Entry>& e) {
+    uint64_t delta = e->expiry - mNow;
+    size_t level = 0;
+    while (level + 1 < Levels && delta >= (uint64_t(1) << (SlotBits * (level + 1)))) ++level;
+    // Too far out for the wheel: park it in the last slot of the top level,
+    // and place it again from there.
+    uint64_t at = e->expiry;
+    if (delta >= (uint64_t(1) << (SlotBits * Levels))) at = mNow + (uint64_t(1) << (SlotBits * Levels)) - 1;
+
+    size_t slot = (at >> (SlotBits * level)) & (Slots - 1);
+    auto& s = mSlots[level][slot];
+    e->level = level;
+    e->slot = slot;
+    e->pos = s.insert(s.end(), e);
+    e->state = Entry::State::ARMED;
+    mOccupied[level] |= uint64_t(1) << slot;
+    ++mSize;
+}
+
+void TimerWheel::unlink(Entry& e) {
+    auto& s = mSlots[e.level][e.slot];
+    s.erase(e.pos);
+    if (s.empty()) mOccupied[e.level] &= ~(uint64_t(1) << e.slot);
+    --mSize;
+}
+
+std::optional<uint64_t> TimerWheel::next() const {
+    std::optional<uint64_t> best;
+    for (size_t level = 0; level < Levels; ++level) {
+        if (!mOccupied[level]) continue;
+        size_t shift = SlotBits * level;
+        uint64_t block = mNow >> shift;
+        // Distance, in slots of this level, to the next occupied one.
+        auto from = int((block + 1) & (Slots - 1));
+        uint64_t d = std::countr_zero(std::rotr(mOccupied[level], from)) + 1;
+        uint64_t tick = level == 0 ? mNow + d : (block + d) << shift;
+        if (!best || tick < *best) best = tick;
+    }
+    return best;
+}
+
+void TimerWheel::advance(uint64_t target, std::vector<std::shared_ptr<Entry>>* due) {
+    while (true) {
+        auto n = next();
+        if (!n || *n > target) {
+            mNow = std::max(mNow, target);
+            return;
+        }
+        mNow = *n;
+
+        // Move timers down from every level that wraps around at this tick.
+        for (size_t level = Levels - 1; level > 0; --level) {
+            size_t shift = SlotBits * level;
+            if (mNow & ((uint64_t(1) << shift) - 1)) continue;
+            size_t slot = (mNow >> shift) & (Slots - 1);
+            Slot moving;
+            moving.swap(mSlots[level][slot]);
+            mOccupied[level] &= ~(uint64_t(1) << slot);
+            mSize -= moving.size();
+            for (auto& e : moving) {
+                if (e->expiry <= mNow) {
+                    e->state = e->interval ? Entry::State::FIRING : Entry::State::DONE;
+                    due->push_back(e);
+                } else {
+                    insert(e);
+                }
+            }
+        }
+
+        size_t slot = mNow & (Slots - 1);
+        for (auto& e : mSlots[0][slot]) {
+            e->state = e->interval ? Entry::State::FIRING : Entry::State::DONE;
+            due->push_back(e);
+        }
+        mSize -= mSlots[0][slot].size();
+        mSlots[0][slot].clear();
+        mOccupied[0] &= ~(uint64_t(1) << slot);
+    }
+}
+
+void TimerWheel::fire(std::shared_ptr<Entry> e) {
+    if (e->interval == 0) {
+        mDispatch(std::move(e->fn), e->priority);
+        return;
+    }
+    auto p = e->priority;
+    mDispatch([this, e = std::move(e)] () -> void {
+        try {
+            e->fn();
+        } catch (...) {
+        }
+        rearm(e);
+    }, p);
+}
+
+void TimerWheel::rearm(const std::shared_ptr<Entry>& e) {
+    std::unique_lock<std::mutex> lk(mMutex);
+    if (mStopped || e->state != Entry::State::FIRING) return;
+    e->expiry = std::max(e->expiry + e->interval, mNow + 1);
+    e->expiry = (e->expiry + mSlack - 1) / mSlack * mSlack;
+    insert(e);
+    if (e->expiry < mNextWake) mWakeup.notify_one();
+}
+
+void TimerWheel::loop() {
+    std::unique_lock<std::mutex> lk(mMutex);
+    while (!mStopped) {
+        std::vector<std::shared_ptr<Entry>> due;
+        advance((Clock::now() - mEpoch) / mTick, &due);
+        if (!due.empty()) {
+            mNextWake = mNow;
+            lk.unlock();
+            for (auto& e : due) fire(std::move(e));
+            lk.lock();
+            continue;
+        }
+        auto n = next();
+        mNextWake = n ? *n : UINT64_MAX;
+        if (n) mWakeup.wait_until(lk, timeof(*n));
+        else mWakeup.wait(lk);
+    }
+}
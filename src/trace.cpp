@@ -0,0 +1,182 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/trace.h>
+#include <beehive/message.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+using namespace beehive;
+
+namespace {
+constexpr uint64_t ArgBits = 48;
+constexpr uint64_t ArgMask = (uint64_t(1) << ArgBits) - 1;
+
+const char* kind(uint8_t k) {
+    switch (Message::Kind(k)) {
+        case Message::Kind::NOP: return "NOP";
+        case Message::Kind::EXIT: return "EXIT";
+        case Message::Kind::TASK: return "TASK";
+        case Message::Kind::DUMP: return "DUMP";
+        case Message::Kind::RENAME: return "RENAME";
+    }
+    return "?";
+}
+
+// Emits one trace event object per call, separated by commas.
+class Writer {
+    public:
+        Writer(std::ostream& os, int64_t origin) : mOut(os), mOrigin(origin) {}
+
+        std::ostream& event(const char* name, const char* ph, int tid, int64_t time) {
+            mOut << (mFirst ? "\n" : ",\n");
+            mFirst = false;
+            auto ns = time - mOrigin;
+            mOut << "{\"name\":\"" << name << "\",\"ph\":\"" << ph << "\",\"pid\":1,\"tid\":" << tid
+                 << ",\"ts\":" << ns / 1000 << "." << std::setw(3) << std::setfill('0') << ns % 1000;
+            return mOut;
+        }
+
+    private:
+        std::ostream& mOut;
+        int64_t mOrigin;
+        bool mFirst = true;
+};
+
+// A JSON string literal, quotes included.
+std::string quoted(const std::string& s) {
+    std::ostringstream ss;
+    ss << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            ss << '\\' << c;
+        } else if (c < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        } else {
+            ss << c;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+// Task pointers, as JSON strings, since they may not fit in a double.
+std::string id(uint64_t arg) {
+    std::ostringstream ss;
+    ss << "\"0x" << std::hex << arg << "\"";
+    return ss.str();
+}
+}
+
+TraceBuffer::TraceBuffer(size_t capacity) :
+    mCapacity(std::max<size_t>(1, capacity)), mSlots(new std::atomic<uint64_t>[2 * mCapacity]) {}
+
+void TraceBuffer::add(Event e, uint64_t arg, uint8_t extra) {
+    auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto head = mHead.load(std::memory_order_relaxed);
+    auto slot = 2 * (head % mCapacity);
+    mSlots[slot].store(t, std::memory_order_relaxed);
+    mSlots[slot + 1].store((arg & ArgMask) | (uint64_t(extra) << ArgBits) | (uint64_t(e) << (ArgBits + 8)),
+                           std::memory_order_relaxed);
+    mHead.store(head + 1, std::memory_order_release);
+}
+
+std::vector<TraceBuffer::Record> TraceBuffer::records() const {
+    auto head = mHead.load(std::memory_order_acquire);
+    auto first = head > mCapacity ? head - mCapacity : 0;
+    std::vector<Record> r;
+    r.reserve(head - first);
+    for (auto i = first; i < head; ++i) {
+        auto slot = 2 * (i % mCapacity);
+        auto packed = mSlots[slot + 1].load(std::memory_order_relaxed);
+        r.push_back(Record{
+            int64_t(mSlots[slot].load(std::memory_order_relaxed)),
+            Event(packed >> (ArgBits + 8)),
+            uint8_t(packed >> ArgBits),
+            packed & ArgMask,
+        });
+    }
+    // The writer may have lapped us: drop what it got to, and the slot it
+    // may be in the middle of.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto now = mHead.load(std::memory_order_relaxed);
+    if (now + 1 > first + mCapacity) {
+        auto stale = std::min<uint64_t>(now + 1 - mCapacity - first, r.size());
+        r.erase(r.begin(), r.begin() + stale);
+    }
+    return r;
+}
+
+void beehive::writeChromeTrace(std::ostream& os, const std::vector<TraceTrack>& tracks) {
+    auto origin = std::numeric_limits<int64_t>::max();
+    for (const auto& t : tracks) {
+        if (!t.records.empty()) origin = std::min(origin, t.records.front().time);
+    }
+    if (origin == std::numeric_limits<int64_t>::max()) origin = 0;
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    Writer w(os, origin);
+    using Event = TraceBuffer::Event;
+    for (const auto& t : tracks) {
+        w.event("thread_name", "M", t.tid, origin) << ",\"args\":{\"name\":" << quoted(t.name) << "}}";
+        // Spans cut short by the start of the buffer have nothing to end.
+        int depth = 0;
+        bool parked = false;
+        for (const auto& r : t.records) {
+            switch (r.event) {
+                case Event::ENQUEUE:
+                    w.event("enqueue", "i", t.tid, r.time) << ",\"s\":\"t\",\"args\":{\"task\":" << id(r.arg)
+                                                           << ",\"priority\":" << int(r.extra) << "}}";
+                    w.event("task", "s", t.tid, r.time) << ",\"cat\":\"task\",\"id\":" << id(r.arg) << "}";
+                    break;
+                case Event::DEQUEUE:
+                    w.event("dequeue", "i", t.tid, r.time) << ",\"s\":\"t\",\"args\":{\"task\":" << id(r.arg)
+                                                           << ",\"priority\":" << int(r.extra) << "}}";
+                    break;
+                case Event::START:
+                    w.event("task", "B", t.tid, r.time) << ",\"args\":{\"task\":" << id(r.arg)
+                                                        << ",\"priority\":" << int(r.extra) << "}}";
+                    w.event("task", "f", t.tid, r.time) << ",\"cat\":\"task\",\"bp\":\"e\",\"id\":"
+                                                        << id(r.arg) << "}";
+                    ++depth;
+                    break;
+                case Event::END:
+                    if (depth == 0) break;
+                    w.event("task", "E", t.tid, r.time) << "}";
+                    --depth;
+                    break;
+                case Event::PARK:
+                    w.event("parked", "B", t.tid, r.time) << "}";
+                    parked = true;
+                    break;
+                case Event::WAKEUP:
+                    if (parked) w.event("parked", "E", t.tid, r.time) << "}";
+                    parked = false;
+                    w.event("wakeup", "i", t.tid, r.time) << ",\"s\":\"t\"}";
+                    break;
+                case Event::MESSAGE:
+                    w.event("message", "i", t.tid, r.time) << ",\"s\":\"t\",\"args\":{\"kind\":\""
+                                                           << kind(r.extra) << "\"}}";
+                    break;
+            }
+        }
+    }
+    os << "\n]}\n";
+}
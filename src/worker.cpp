@@ -18,12 +18,20 @@ limitations under the License.
 #include <beehive/worker.h>
 #include <beehive/pool.h>
 #include <beehive/platform.h>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
 using namespace beehive;
 
 Worker::Worker(Pool* parent, int id) : mParent(parent), mId(id) {
+    if (parent->options().mailbox == Mailbox::RING) {
+        mMsgQueue.emplace<RingQueue>();
+    }
+    std::visit([parent] (auto& q) -> void {
+        q.spin(parent->options().spin);
+    }, mMsgQueue);
+    if (auto n = parent->options().tracing) mTrace = std::make_unique<TraceBuffer>(n);
     mWorkThread = std::thread([this] {
         this->WorkLoop();
     });
@@ -31,15 +39,22 @@ Worker::Worker(Pool* parent, int id) : mParent(parent), mId(id) {
 }
 
 static std::mutex gDumpMutex;
+static thread_local Worker* gCurrentWorker = nullptr;
+
+Worker* Worker::current() {
+    return gCurrentWorker;
+}
+
+Message::Handler::Result Worker::handle(const Message& msg) {
+    if (mTrace) mTrace->add(TraceBuffer::Event::MESSAGE, 0, uint8_t(msg.kind()));
+    return Message::Handler::handle(msg);
+}
 
 void Worker::onBeforeMessage() {
-    mStats.idle().stop();
-    mStats.active().start();
     mStats.message();
 }
 void Worker::onAfterMessage() {
-    mStats.active().stop();
-    mStats.idle().start();
+    mStats.done();
 }
 
 Message::Handler::Result Worker::onNop(const Message::NOP_Data&) {
@@ -48,12 +63,34 @@ Message::Handler::Result Worker::onNop(const Message::NOP_Data&) {
 Message::Handler::Result Worker::onExit(const Message::EXIT_Data&) {
     return Message::Handler::Result::FINISH;
 }
+// A TASK message means that the Pool picked this worker out of the parked
+// ones. Keep running tasks until there are none left, then park again.
 Message::Handler::Result Worker::onTask(const Message::TASK_Data&) {
-    auto task = mParent->task();
-    if (task) {
-        mStats.run();
-        task->run();
-    }
+    using Event = TraceBuffer::Event;
+    if (mTrace) mTrace->add(Event::WAKEUP);
+    bool ran = false;
+    do {
+        while (!mRetiring.load(std::memory_order_relaxed)) {
+            Task::Priority p;
+            auto task = mParent->task(&p);
+            if (!task) break;
+            ran = true;
+            mStats.run();
+            auto id = reinterpret_cast<uintptr_t>(task.get());
+            if (mTrace) {
+                mTrace->add(Event::DEQUEUE, id, p);
+                mTrace->add(Event::START, id, p);
+            }
+            auto start = std::chrono::steady_clock::now();
+            task->run();
+            auto band = Task::band(p);
+            mWaitTimes[band].add(start - task->enqueued());
+            mRunTimes[band].add(std::chrono::steady_clock::now() - start);
+            if (mTrace) mTrace->add(Event::END, id, p);
+        }
+    } while (!mRetiring.load(std::memory_order_relaxed) && !mParent->park(mId));
+    if (mTrace && !mRetiring.load(std::memory_order_relaxed)) mTrace->add(Event::PARK);
+    mStats.wakeup(!ran);
     return Message::Handler::Result::CONTINUE;
 }
 Message::Handler::Result Worker::onDump(const Message::DUMP_Data&) {
@@ -62,8 +99,9 @@ Message::Handler::Result Worker::onDump(const Message::DUMP_Data&) {
     std::cerr << "Thread: " << name() << std::endl;
     std::cerr << "Number of tasks ran: " << s.runs << std::endl;
     std::cerr << "Number of messages processed: " << s.messages << std::endl;
-    std::cerr << "Time active: " << s.active.count() << " milliseconds" << std::endl;
-    std::cerr << "Time idle: " << s.idle.count() << " milliseconds" << std::endl;
+    std::cerr << "Number of wakeups: " << s.wakeups << " (" << s.wasted << " wasted)" << std::endl;
+    std::cerr << "Time active: " << s.active.count() << " nanoseconds" << std::endl;
+    std::cerr << "Time idle: " << s.idle.count() << " nanoseconds" << std::endl;
     return Message::Handler::Result::CONTINUE;
 }
 Message::Handler::Result Worker::onRename(const Message::RENAME_Data& r) {
@@ -72,14 +110,26 @@ Message::Handler::Result Worker::onRename(const Message::RENAME_Data& r) {
 }
 
 void Worker::WorkLoop() {
-    mStats.idle().start();
-    mMsgQueue.loop(this);
+    gCurrentWorker = this;
+    std::visit([this] (auto& q) -> void {
+        q.loop(this);
+    }, mMsgQueue);
+    mFinished.store(true);
 }
 
 Worker::Stats Worker::stats() {
     return mStats.load();
 }
 
+void Worker::latency(size_t band, Histogram* wait, Histogram* run) const {
+    mWaitTimes[band].addto(wait);
+    mRunTimes[band].addto(run);
+}
+
+TraceBuffer* Worker::trace() const {
+    return mTrace.get();
+}
+
 std::string Worker::name() {
     return Platform::name(nativeid());
 }
@@ -94,13 +144,17 @@ void Worker::name(const char* n) {
         name = ss.str();
     }
 
-    send(Message::RENAME_Data{name});
+    Platform::name(nativeid(), name.c_str());
 }
 
 int Worker::id() const {
     return mId;
 }
 
+Pool* Worker::pool() const {
+    return mParent;
+}
+
 std::thread::id Worker::tid() {
     return mWorkThread.get_id();
 }
@@ -110,12 +164,14 @@ std::thread::native_handle_type Worker::nativeid() {
 }
 
 void Worker::send(Message m) {
-    mMsgQueue.send(m);
+    std::visit([&m] (auto& q) -> void {
+        q.send(std::move(m));
+    }, mMsgQueue);
 }
 
 Worker::~Worker() {
     exit();
-    mWorkThread.join();
+    join();
 }
 
 Worker::View Worker::view() {
@@ -126,6 +182,19 @@ void Worker::exit() {
     send(Message{Message::EXIT_Data{}});
 }
 
+void Worker::retire() {
+    mRetiring.store(true);
+    exit();
+}
+
+void Worker::join() {
+    if (mWorkThread.joinable()) mWorkThread.join();
+}
+
+bool Worker::finished() const {
+    return mFinished.load();
+}
+
 void Worker::task() {
     send(Message{Message::TASK_Data{}});
 }
@@ -142,35 +211,95 @@ void Worker::affinity(const std::vector<bool>& a) {
     Platform::affinity(nativeid(), a);
 }
 
-Worker::AtomicStats::AtomicStats() = default;
+Worker::AtomicStats::AtomicStats() : mSince(now()) {}
+
+int64_t Worker::AtomicStats::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// There is only one writer, so a load and a store make an increment.
+template<typename T>
+void Worker::AtomicStats::add(std::atomic<T>& a, T n) {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
 
-Worker::Stats Worker::AtomicStats::load() {
+void Worker::AtomicStats::begin() {
+    mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Worker::AtomicStats::end() {
+    mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+Worker::Stats Worker::AtomicStats::load() const {
     Stats s;
-    s.messages = mMessages.load();
-    s.runs = mRuns.load();
-    s.idle = mIdle.value();
-    s.active = mActive.value();
+    int64_t since;
+    int64_t t;
+    bool active;
+    // The time is taken within the read, so that the current stretch is
+    // never counted past the next switch of the worker.
+    while (true) {
+        auto seq = mSequence.load(std::memory_order_acquire);
+        if (seq & 1) {
+            Platform::relax();
+            continue;
+        }
+        s.messages = mMessages.load(std::memory_order_relaxed);
+        s.runs = mRuns.load(std::memory_order_relaxed);
+        s.wakeups = mWakeups.load(std::memory_order_relaxed);
+        s.wasted = mWasted.load(std::memory_order_relaxed);
+        s.idle = std::chrono::nanoseconds(mIdleTime.load(std::memory_order_relaxed));
+        s.active = std::chrono::nanoseconds(mActiveTime.load(std::memory_order_relaxed));
+        since = mSince.load(std::memory_order_relaxed);
+        active = mActive.load(std::memory_order_relaxed);
+        t = now();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mSequence.load(std::memory_order_relaxed) == seq) break;
+    }
+    auto current = std::chrono::nanoseconds(std::max<int64_t>(0, t - since));
+    (active ? s.active : s.idle) += current;
     return s;
 }
 
 void Worker::AtomicStats::message() {
-    mMessages.fetch_add(1);
+    begin();
+    auto t = now();
+    add(mIdleTime, t - mSince.load(std::memory_order_relaxed));
+    mSince.store(t, std::memory_order_relaxed);
+    mActive.store(true, std::memory_order_relaxed);
+    add(mMessages, uint64_t(1));
+    end();
 }
 
-void Worker::AtomicStats::run() {
-    mRuns.fetch_add(1);
+void Worker::AtomicStats::done() {
+    begin();
+    auto t = now();
+    add(mActiveTime, t - mSince.load(std::memory_order_relaxed));
+    mSince.store(t, std::memory_order_relaxed);
+    mActive.store(false, std::memory_order_relaxed);
+    end();
 }
 
-TimeCounter& Worker::AtomicStats::active() {
-    return mActive;
+void Worker::AtomicStats::run() {
+    begin();
+    add(mRuns, uint64_t(1));
+    end();
 }
-TimeCounter& Worker::AtomicStats::idle() {
-    return mIdle;
+
+void Worker::AtomicStats::wakeup(bool wasted) {
+    begin();
+    add(mWakeups, uint64_t(1));
+    if (wasted) add(mWasted, uint64_t(1));
+    end();
 }
 
 bool Worker::Stats::operator==(const Stats& rhs) const {
     return (messages == rhs.messages) &&
            (runs == rhs.runs) &&
+           (wakeups == rhs.wakeups) &&
+           (wasted == rhs.wasted) &&
            (idle == rhs.idle) &&
            (active == rhs.active);
 }
@@ -0,0 +1,86 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/autoscaler.h>
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace beehive;
+using namespace std::chrono_literals;
+
+namespace {
+// Stepped by hand, as far as the tests go.
+Autoscaler::Options manual(size_t min, size_t max) {
+    Autoscaler::Options opts;
+    opts.min = min;
+    opts.max = max;
+    opts.interval = 1h;
+    return opts;
+}
+}
+
+TEST(Autoscaler, GrowsUnderBacklog) {
+    Pool pool(1);
+    Autoscaler scaler(&pool, manual(1, 4));
+
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 0; i < 20; ++i) {
+        futures.push_back(pool.schedule([gate] () -> void { gate.wait(); }));
+    }
+
+    // Every worker is stuck, and tasks are waiting.
+    while (pool.idleworkers() > 0) std::this_thread::sleep_for(1ms);
+    while (pool.size() < 4) ASSERT_GT(scaler.step(), 0);
+    ASSERT_EQ(0, scaler.step());
+    ASSERT_EQ(4, pool.size());
+
+    release.set_value();
+    for (auto& f : futures) f.wait();
+}
+
+TEST(Autoscaler, ShrinksWhenIdle) {
+    Pool pool(4);
+    Autoscaler scaler(&pool, manual(2, 4));
+
+    while (pool.idleworkers() < 4) std::this_thread::sleep_for(1ms);
+    while (pool.size() > 2) {
+        std::this_thread::sleep_for(5ms);
+        scaler.step();
+    }
+    ASSERT_EQ(2, pool.size());
+    std::this_thread::sleep_for(5ms);
+    ASSERT_EQ(0, scaler.step());
+
+    pool.schedule([] () -> void {}).wait();
+}
+
+TEST(Autoscaler, KeepsWithinBounds) {
+    Pool pool(1);
+    {
+        Autoscaler scaler(&pool, manual(3, 5));
+        scaler.step();
+        ASSERT_EQ(3, pool.size());
+    }
+    Autoscaler scaler(&pool, manual(1, 2));
+    scaler.step();
+    ASSERT_EQ(2, pool.size());
+}
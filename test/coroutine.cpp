@@ -0,0 +1,97 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/beehive.h>
+#include "gtest/gtest.h"
+#include <stdexcept>
+#include <thread>
+
+using namespace beehive;
+
+TEST(Coroutine, ScheduleOn) {
+    Beehive beehive(2);
+    auto caller = std::this_thread::get_id();
+    auto hop = [] (Beehive& beehive) -> Coroutine<std::thread::id> {
+        co_await beehive.schedule_on();
+        co_return std::this_thread::get_id();
+    };
+    auto tid = sync_wait(hop(beehive));
+    ASSERT_NE(caller, tid);
+}
+
+TEST(Coroutine, AwaitFuture) {
+    Beehive beehive(2);
+    auto add = [] (Beehive& beehive, int x) -> Coroutine<int> {
+        int y = co_await beehive.schedule([] (int x) -> int {
+            return x * 2;
+        }, x);
+        co_return y + 1;
+    };
+    ASSERT_EQ(43, sync_wait(add(beehive, 21)));
+}
+
+TEST(Coroutine, AwaitCoroutine) {
+    Beehive beehive(2);
+    auto leaf = [] (Beehive& beehive, int x) -> Coroutine<int> {
+        co_await beehive.schedule_on();
+        co_return x * x;
+    };
+    auto root = [leaf] (Beehive& beehive) -> Coroutine<int> {
+        int total = 0;
+        for (int i = 1; i <= 10; ++i) total += co_await leaf(beehive, i);
+        co_return total;
+    };
+    ASSERT_EQ(385, sync_wait(root(beehive)));
+}
+
+TEST(Coroutine, Void) {
+    Beehive beehive(2);
+    bool ran = false;
+    auto work = [] (Beehive& beehive, bool& ran) -> Coroutine<> {
+        co_await beehive.schedule_on();
+        ran = true;
+    };
+    sync_wait(work(beehive, ran));
+    ASSERT_TRUE(ran);
+}
+
+TEST(Coroutine, Exception) {
+    Beehive beehive(2);
+    auto fail = [] (Beehive& beehive) -> Coroutine<int> {
+        co_await beehive.schedule([] () -> void {
+            throw std::runtime_error("sting");
+        });
+        co_return 0;
+    };
+    ASSERT_THROW(sync_wait(fail(beehive)), std::runtime_error);
+}
+
+TEST(Coroutine, AwaitFreesWorker) {
+    // With a single worker, each awaited task can only run if the coroutine
+    // gave the worker back while waiting for it.
+    Beehive beehive(1);
+    auto count = [] (Beehive& beehive) -> Coroutine<int> {
+        co_await beehive.schedule_on();
+        int n = 0;
+        for (int i = 0; i < 1000; ++i) {
+            n = co_await beehive.schedule([n] () -> int {
+                return n + 1;
+            });
+        }
+        co_return n;
+    };
+    ASSERT_EQ(1000, sync_wait(count(beehive)));
+}
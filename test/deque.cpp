@@ -0,0 +1,79 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/deque.h>
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace beehive;
+
+TEST(StealingDeque, EmptyDeque) {
+    StealingDeque<int, std::string> dq;
+    ASSERT_TRUE(dq.empty());
+    ASSERT_EQ(0, dq.size());
+    ASSERT_EQ(std::nullopt, dq.top());
+    ASSERT_EQ(std::nullopt, dq.pop());
+    ASSERT_EQ(std::nullopt, dq.steal());
+}
+
+TEST(StealingDeque, PopIsLifo) {
+    StealingDeque<int, int> dq;
+    dq.push(1, 10);
+    dq.push(1, 20);
+    dq.push(1, 30);
+    ASSERT_EQ(3, dq.size());
+    ASSERT_EQ(30, dq.pop());
+    ASSERT_EQ(20, dq.pop());
+    ASSERT_EQ(10, dq.pop());
+    ASSERT_TRUE(dq.empty());
+}
+
+TEST(StealingDeque, StealIsFifo) {
+    StealingDeque<int, int> dq;
+    dq.push(1, 10);
+    dq.push(1, 20);
+    dq.push(1, 30);
+    ASSERT_EQ(10, dq.steal());
+    ASSERT_EQ(30, dq.pop());
+    ASSERT_EQ(20, dq.steal());
+    ASSERT_TRUE(dq.empty());
+}
+
+TEST(StealingDeque, Priority) {
+    StealingDeque<int, int> dq;
+    int p = 0;
+    dq.push(100, 1);
+    dq.push(300, 2);
+    dq.push(200, 3);
+    ASSERT_EQ(300, dq.top());
+    ASSERT_EQ(2, dq.steal(&p));
+    ASSERT_EQ(300, p);
+    ASSERT_EQ(200, dq.top());
+    ASSERT_EQ(3, dq.pop(&p));
+    ASSERT_EQ(200, p);
+    ASSERT_EQ(1, dq.pop(&p));
+    ASSERT_EQ(100, p);
+    ASSERT_EQ(std::nullopt, dq.top());
+}
+
+TEST(StealingDeque, MinFirst) {
+    StealingDeque<int, int, MinFirst> dq;
+    dq.push(300, 1);
+    dq.push(100, 2);
+    ASSERT_EQ(100, dq.top());
+    ASSERT_EQ(2, dq.pop());
+    ASSERT_EQ(1, dq.pop());
+}
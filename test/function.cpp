@@ -0,0 +1,81 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/function.h>
+#include "gtest/gtest.h"
+#include <array>
+#include <memory>
+#include <string>
+
+using namespace beehive;
+
+TEST(UniqueFunction, Empty) {
+    UniqueFunction<void()> f;
+    ASSERT_FALSE(f);
+    ASSERT_THROW(f(), std::bad_function_call);
+}
+
+TEST(UniqueFunction, Call) {
+    UniqueFunction<int(int, int)> f = [] (int x, int y) -> int {
+        return x * y;
+    };
+    ASSERT_TRUE(f);
+    ASSERT_EQ(12, f(3, 4));
+}
+
+TEST(UniqueFunction, MoveOnlyTarget) {
+    auto p = std::make_unique<int>(42);
+    UniqueFunction<int()> f = [p = std::move(p)] () -> int {
+        return *p;
+    };
+    ASSERT_EQ(42, f());
+}
+
+TEST(UniqueFunction, Move) {
+    auto p = std::make_shared<int>(1);
+    UniqueFunction<int()> f = [p] () -> int {
+        return *p + 1;
+    };
+    ASSERT_EQ(2, p.use_count());
+    UniqueFunction<int()> g = std::move(f);
+    ASSERT_FALSE(f);
+    ASSERT_EQ(2, g());
+    ASSERT_EQ(2, p.use_count());
+    g = nullptr;
+    ASSERT_EQ(1, p.use_count());
+}
+
+TEST(UniqueFunction, LargeTarget) {
+    std::array<int, 64> a;
+    a.fill(3);
+    auto big = [a] () -> int {
+        return a[10];
+    };
+    static_assert(!UniqueFunction<int()>::fits<decltype(big)>());
+    UniqueFunction<int()> f = big;
+    UniqueFunction<int()> g = std::move(f);
+    ASSERT_EQ(3, g());
+}
+
+TEST(UniqueFunction, SmallTargetIsInline) {
+    std::string s = "hello";
+    auto small = [s, n = 1] () -> size_t {
+        return s.size() + n;
+    };
+    static_assert(UniqueFunction<size_t()>::fits<decltype(small)>());
+    UniqueFunction<size_t()> f = small;
+    ASSERT_EQ(6, f());
+}
@@ -0,0 +1,85 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/histogram.h>
+#include "gtest/gtest.h"
+#include <chrono>
+#include <thread>
+
+using namespace beehive;
+using namespace std::chrono_literals;
+
+TEST(Histogram, Buckets) {
+    for (uint64_t v = 0; v < Histogram::SubBuckets; ++v) {
+        ASSERT_EQ(v, Histogram::bucket(v));
+        ASSERT_EQ(v, Histogram::lower(v));
+        ASSERT_EQ(v, Histogram::upper(v));
+    }
+    for (uint64_t v : {8ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, ~0ull}) {
+        auto b = Histogram::bucket(v);
+        ASSERT_LT(b, Histogram::Buckets);
+        ASSERT_LE(Histogram::lower(b), v);
+        ASSERT_GE(Histogram::upper(b), v);
+        // Precise to within an eighth.
+        ASSERT_LE(Histogram::upper(b) - Histogram::lower(b), v / Histogram::SubBuckets);
+    }
+    for (size_t b = 1; b < Histogram::Buckets; ++b) {
+        ASSERT_EQ(Histogram::upper(b - 1) + 1, Histogram::lower(b));
+    }
+}
+
+TEST(Histogram, Quantiles) {
+    Histogram h;
+    ASSERT_EQ(0ns, h.quantile(0.5));
+    ASSERT_EQ(0ns, h.max());
+
+    for (int i = 1; i <= 100; ++i) h.add(std::chrono::microseconds(i));
+    ASSERT_EQ(100, h.count());
+    auto near = [] (std::chrono::nanoseconds a, std::chrono::nanoseconds b) -> bool {
+        return a >= b && a <= b + b / 8;
+    };
+    ASSERT_TRUE(near(h.quantile(0), 1us));
+    ASSERT_TRUE(near(h.quantile(0.5), 50us));
+    ASSERT_TRUE(near(h.quantile(0.99), 99us));
+    ASSERT_TRUE(near(h.quantile(1), 100us));
+    ASSERT_EQ(h.quantile(1), h.max());
+}
+
+TEST(Histogram, Merge) {
+    Histogram a;
+    Histogram b;
+    a.add(10ns, 3);
+    b.add(10ns);
+    b.add(1ms);
+    a.merge(b);
+    ASSERT_EQ(5, a.count());
+    ASSERT_EQ(4, a.count(Histogram::bucket(10)));
+    ASSERT_TRUE(a.max() >= 1ms);
+}
+
+TEST(Histogram, Atomic) {
+    AtomicHistogram ah;
+    std::thread writer([&ah] () -> void {
+        for (int i = 0; i < 10000; ++i) ah.add(std::chrono::nanoseconds(i));
+    });
+    writer.join();
+
+    Histogram h;
+    ah.addto(&h);
+    ah.addto(&h);
+    ASSERT_EQ(20000, h.count());
+    ASSERT_TRUE(h.max() >= 9999ns);
+}
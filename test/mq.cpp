@@ -17,6 +17,7 @@ limitations under the License.
 #include <beehive/mq.h>
 #include <beehive/message.h>
 #include "gtest/gtest.h"
+#include <atomic>
 #include <thread>
 #include <chrono>
 
@@ -276,3 +277,73 @@ TEST(SignalingQueue, HandlerThread) {
 
     ASSERT_STREQ("hello", th.name(0));
 }
+
+// onStart() runs as soon as the thread does, not when a first message comes.
+TEST(SignalingQueue, HandlerThreadStartsBeforeMessages) {
+    class TestHandler : public HandlerThread<Message> {
+        public:
+            void onStart() override {
+                mStarted = true;
+            }
+            void onBeforeMessage() override {
+                if (!mStarted) mEarly = true;
+            }
+
+            bool started() const { return mStarted; }
+            bool early() const { return mEarly; }
+
+        private:
+            std::atomic<bool> mStarted{false};
+            std::atomic<bool> mEarly{false};
+    };
+
+    TestHandler th;
+    th.start();
+    while (!th.started()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    th.queue()->send({Message::EXIT_Data{}});
+    th.join();
+    ASSERT_FALSE(th.early());
+}
+
+TEST(RingMessageQueue, ReceiveInOrder) {
+    RingMessageQueue<Message> mq;
+    ASSERT_TRUE(mq.empty());
+    mq.send({Message::EXIT_Data{}});
+    mq.send({Message::RENAME_Data{"hello"}});
+    auto m1 = mq.receive();
+    auto m2 = mq.receive();
+    ASSERT_TRUE(m1);
+    ASSERT_EQ(Message::Kind::EXIT, m1->kind());
+    ASSERT_TRUE(m2);
+    ASSERT_EQ("hello", m2->rename()->name);
+    ASSERT_FALSE(mq.receive());
+}
+
+TEST(RingMessageQueue, SendBlocksWhenFull) {
+    RingMessageQueue<int, 2> mq;
+    mq.send(1);
+    mq.send(2);
+    std::thread t1([&mq] () -> void {
+        mq.send(3);
+    });
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(1, mq.receive());
+    t1.join();
+    ASSERT_EQ(2, mq.receive());
+    ASSERT_EQ(3, mq.receive());
+}
+
+TEST(SignalingQueue, RingSendReceive) {
+    SignalingQueue<Message, RingMessageQueue<Message>> sq;
+    std::thread t1([&sq] () -> void {
+        std::this_thread::sleep_for(200ms);
+        sq.send({Message::TASK_Data{}});
+    });
+    std::optional<Message> m;
+    std::thread t2([&sq, &m] () -> void {
+        m = sq.receive();
+    });
+    t2.join();
+    ASSERT_EQ(Message::Kind::TASK, m->kind());
+    t1.join();
+}
@@ -0,0 +1,66 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/parker.h>
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace beehive;
+using namespace std::chrono_literals;
+
+TEST(Parker, UnparkBeforePark) {
+    Parker p;
+    p.unpark();
+    p.park();
+}
+
+TEST(Parker, TokensDoNotAccumulate) {
+    Parker p;
+    std::atomic<bool> woken = false;
+    p.unpark();
+    p.unpark();
+    p.park();
+    std::thread t1([&p, &woken] () -> void {
+        p.park();
+        woken = true;
+    });
+    std::this_thread::sleep_for(200ms);
+    ASSERT_FALSE(woken);
+    p.unpark();
+    t1.join();
+    ASSERT_TRUE(woken);
+}
+
+TEST(Parker, PingPong) {
+    Parker ping;
+    Parker pong;
+    std::atomic<int> n = 0;
+    std::thread t1([&] () -> void {
+        for (int i = 0; i < 1000; ++i) {
+            ping.park();
+            ++n;
+            pong.unpark();
+        }
+    });
+    for (int i = 0; i < 1000; ++i) {
+        ping.unpark();
+        pong.park();
+    }
+    t1.join();
+    ASSERT_EQ(1000, n);
+}
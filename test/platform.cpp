@@ -18,6 +18,10 @@ limitations under the License.
 #include <beehive/worker.h>
 #include <beehive/platform.h>
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
 
 using namespace beehive;
 
@@ -36,3 +40,110 @@ TEST(Platform, Affinity) {
     ASSERT_TRUE(c[0]);
     for (size_t i = 1; i < c.size(); ++i) ASSERT_FALSE(c[i]);
 }
+
+TEST(Platform, CpuList) {
+    ASSERT_EQ(std::vector<size_t>({0, 1, 2, 3, 8, 10, 11}), Platform::cpulist("0-3,8,10-11\n"));
+    ASSERT_EQ(std::vector<size_t>({5}), Platform::cpulist("5"));
+    ASSERT_TRUE(Platform::cpulist("").empty());
+}
+
+namespace {
+void write(const std::filesystem::path& p, const std::string& s) {
+    std::filesystem::create_directories(p.parent_path());
+    std::ofstream(p) << s << "\n";
+}
+
+// Two packages, each one NUMA node with a shared L3, of two cores with two
+// threads each. SMT siblings are numbered 4 apart.
+Topology fake(const std::string& isolated = "") {
+    auto root = std::filesystem::temp_directory_path() / ("beehive-sysfs-" + std::to_string(getpid()));
+    std::filesystem::remove_all(root);
+    write(root / "cpu" / "online", "0-7");
+    write(root / "cpu" / "isolated", isolated);
+    write(root / "node" / "node0" / "cpulist", "0-1,4-5");
+    write(root / "node" / "node1" / "cpulist", "2-3,6-7");
+    for (int c = 0; c < 8; ++c) {
+        auto cpu = root / "cpu" / ("cpu" + std::to_string(c));
+        int package = (c % 4) / 2;
+        write(cpu / "topology" / "physical_package_id", std::to_string(package));
+        write(cpu / "topology" / "thread_siblings_list", std::to_string(c % 4) + "," + std::to_string(c % 4 + 4));
+        write(cpu / "cache" / "index0" / "level", "1");
+        write(cpu / "cache" / "index0" / "type", "Data");
+        write(cpu / "cache" / "index0" / "shared_cpu_list", std::to_string(c % 4) + "," + std::to_string(c % 4 + 4));
+        write(cpu / "cache" / "index1" / "level", "1");
+        write(cpu / "cache" / "index1" / "type", "Instruction");
+        write(cpu / "cache" / "index1" / "shared_cpu_list", std::to_string(c));
+        write(cpu / "cache" / "index2" / "level", "3");
+        write(cpu / "cache" / "index2" / "type", "Unified");
+        write(cpu / "cache" / "index2" / "shared_cpu_list", package ? "2-3,6-7" : "0-1,4-5");
+    }
+
+    auto t = Platform::topology(root.string());
+    std::filesystem::remove_all(root);
+    return t;
+}
+}
+
+TEST(Platform, TopologyFromSysfs) {
+    auto t = fake();
+
+    ASSERT_EQ(8, t.cpus.size());
+    ASSERT_EQ(2, t.packages);
+    ASSERT_EQ(2, t.nodes);
+    ASSERT_EQ(2, t.llcs);
+    ASSERT_EQ(4, t.cores);
+    for (const auto& c : t.cpus) {
+        size_t package = (c.id % 4) / 2;
+        ASSERT_EQ(package, c.package);
+        ASSERT_EQ(package, c.node);
+        ASSERT_EQ(package, c.llc);
+        ASSERT_EQ(t.cpus[c.id % 4].core, c.core);
+        ASSERT_FALSE(c.isolated);
+    }
+    ASSERT_NE(t.cpus[0].core, t.cpus[1].core);
+}
+
+TEST(Platform, Topology) {
+    const auto& t = Platform::topology();
+    ASSERT_FALSE(t.cpus.empty());
+    ASSERT_GE(t.llcs, 1);
+    ASSERT_GE(t.nodes, 1);
+    for (const auto& c : t.cpus) {
+        ASSERT_LT(c.package, t.packages);
+        ASSERT_LT(c.node, t.nodes);
+        ASSERT_LT(c.llc, t.llcs);
+        ASSERT_LT(c.core, t.cores);
+    }
+}
+
+TEST(Platform, Placement) {
+    auto t = fake();
+    ASSERT_TRUE(Platform::placement(t, Placement::NONE).empty());
+    ASSERT_EQ(std::vector<size_t>({0, 4, 1, 5, 2, 6, 3, 7}), Platform::placement(t, Placement::COMPACT));
+    ASSERT_EQ(std::vector<size_t>({0, 2, 1, 3, 4, 6, 5, 7}), Platform::placement(t, Placement::SCATTER));
+    ASSERT_EQ(std::vector<size_t>({0, 1, 2, 3}), Platform::placement(t, Placement::CORES));
+}
+
+TEST(Platform, PlacementSkipsIsolated) {
+    auto t = fake("1,5");
+    ASSERT_TRUE(t.cpus[1].isolated);
+    ASSERT_TRUE(t.cpus[5].isolated);
+    ASSERT_EQ(std::vector<size_t>({0, 4, 2, 6, 3, 7}), Platform::placement(t, Placement::COMPACT));
+    ASSERT_EQ(std::vector<size_t>({0, 2, 3}), Platform::placement(t, Placement::CORES));
+
+    auto all = fake("0-7");
+    ASSERT_EQ(4, Platform::placement(all, Placement::CORES).size());
+}
+
+TEST(Platform, PoolPlacement) {
+    for (auto placement : {Placement::COMPACT, Placement::SCATTER, Placement::CORES}) {
+        Pool::Options opts;
+        opts.placement = placement;
+        Pool pool(2, opts);
+        for (int i = 0; i < 2; ++i) {
+            auto aff = pool.worker(i).affinity();
+            ASSERT_EQ(1, std::count(aff.begin(), aff.end(), true));
+        }
+        pool.schedule([] () -> void {}).wait();
+    }
+}
@@ -21,6 +21,8 @@ limitations under the License.
 #include <thread>
 #include <chrono>
 #include <algorithm>
+#include <mutex>
+#include <vector>
 #include <beehive/task.h>
 
 using namespace beehive;
@@ -125,7 +127,7 @@ TEST(Pool, CounterStats) {
         tasks += kv.runs;
     });
     ASSERT_EQ(4, tasks);
-    ASSERT_TRUE(messages >= 4);
+    ASSERT_TRUE(messages >= 1);
 }
 
 TEST(Pool, TimeStats) {
@@ -143,13 +145,83 @@ TEST(Pool, TimeStats) {
     f3.wait();
     f4.wait();
     auto stats = pool.stats();
-    std::chrono::milliseconds active;
+    std::chrono::nanoseconds active{0};
     std::for_each(stats.begin(), stats.end(), [&active] (const auto& kv) -> void {
         active += kv.active;
     });
     ASSERT_TRUE(active >= 400ms);
 }
 
+TEST(Pool, ShortTasksShowActiveTime) {
+    Pool pool(1);
+    for (int i = 0; i < 100; ++i) pool.schedule([] () -> void {}).wait();
+    auto stats = pool.stats();
+    ASSERT_LT(0ns, stats.at(0).active);
+    ASSERT_LT(0ns, stats.at(0).idle);
+}
+
+TEST(Pool, StatsSnapshots) {
+    Pool pool(2);
+    std::atomic<bool> done{false};
+    std::thread reader([&pool, &done] () -> void {
+        std::vector<Worker::Stats> last(2);
+        while (!done.load()) {
+            auto stats = pool.stats();
+            for (size_t i = 0; i < stats.size(); ++i) {
+                ASSERT_LE(stats[i].wasted, stats[i].wakeups);
+                ASSERT_LE(last[i].runs, stats[i].runs);
+                ASSERT_LE(last[i].active, stats[i].active);
+                ASSERT_LE(last[i].idle, stats[i].idle);
+                last[i] = stats[i];
+            }
+        }
+    });
+    for (int i = 0; i < 1000; ++i) pool.schedule([] () -> void {}).wait();
+    done.store(true);
+    reader.join();
+}
+
+TEST(Pool, Latency) {
+    Pool pool(1);
+    std::promise<void> release;
+    std::atomic<bool> started{false};
+    auto gate = release.get_future().share();
+    auto blocker = pool.schedule([gate, &started] () -> void {
+        started = true;
+        gate.wait();
+    });
+    while (!started) std::this_thread::sleep_for(1ms);
+
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 0; i < 3; ++i) {
+        futures.push_back(pool.schedule([] () -> void { std::this_thread::sleep_for(5ms); }, Task::MinPriority));
+    }
+    futures.push_back(pool.schedule([] () -> void {}, Task::MaxPriority));
+
+    auto l = pool.latency();
+    ASSERT_EQ(Task::Bands, l.size());
+    ASSERT_EQ(Task::MinPriority, l.front().lowest);
+    ASSERT_EQ(Task::MaxPriority, l.back().highest);
+    ASSERT_EQ(3, l.front().depth);
+    ASSERT_EQ(1, l.back().depth);
+
+    std::this_thread::sleep_for(10ms);
+    release.set_value();
+    blocker.wait();
+    for (auto& f : futures) f.wait();
+    // Times are recorded once the task is done, after its future is ready.
+    while (pool.idleworkers() == 0) std::this_thread::sleep_for(1ms);
+
+    l = pool.latency();
+    ASSERT_EQ(0, l.front().depth);
+    ASSERT_EQ(3, l.front().run.count());
+    ASSERT_GE(l.front().run.quantile(0.5), 5ms);
+    ASSERT_GE(l.front().wait.quantile(0), 10ms);
+    ASSERT_EQ(1, l.back().run.count());
+    ASSERT_GE(l.back().wait.max(), 10ms);
+    ASSERT_EQ(1, l[Task::band(Task::DefaultPriority)].run.count());
+}
+
 TEST(Pool, HyveOfZero) {
     Pool pool;
     ASSERT_TRUE(pool.size() > 0);
@@ -247,6 +319,105 @@ TEST(Pool, AddWorker) {
     ASSERT_EQ("worker[2]", pool.worker(2).name());
 }
 
+TEST(Pool, RemoveWorker) {
+    for (auto scheduling : {Pool::Scheduling::SHARED, Pool::Scheduling::STEALING}) {
+        Pool::Options opts;
+        opts.scheduling = scheduling;
+        Pool pool(3, opts);
+
+        std::atomic<int> count{0};
+        std::vector<std::shared_future<void>> futures;
+        for (int i = 0; i < 100; ++i) {
+            futures.push_back(pool.schedule([&count] () -> void {
+                std::this_thread::sleep_for(100us);
+                ++count;
+            }));
+        }
+
+        ASSERT_TRUE(pool.removeworker());
+        ASSERT_EQ(2, pool.size());
+        ASSERT_TRUE(pool.removeworker());
+        ASSERT_EQ(1, pool.size());
+        ASSERT_FALSE(pool.removeworker());
+        ASSERT_EQ(1, pool.size());
+
+        for (auto& f : futures) f.wait();
+        ASSERT_EQ(100, count.load());
+
+        pool.addworker();
+        ASSERT_EQ(2, pool.size());
+        pool.schedule([] () -> void {}).wait();
+    }
+}
+
+TEST(Pool, RemoveBusyWorker) {
+    Pool pool(2);
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+    std::atomic<int> started{0};
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 0; i < 2; ++i) {
+        futures.push_back(pool.schedule([gate, &started] () -> void {
+            ++started;
+            gate.wait();
+        }));
+    }
+    while (started < 2) std::this_thread::sleep_for(1ms);
+
+    // Both workers are stuck: removing one must not wait for its task.
+    ASSERT_TRUE(pool.removeworker());
+    ASSERT_EQ(1, pool.size());
+    pool.addworker();
+    ASSERT_EQ(2, pool.size());
+
+    release.set_value();
+    for (auto& f : futures) f.wait();
+    pool.schedule([] () -> void {}).wait();
+    ASSERT_TRUE(pool.removeworker());
+}
+
+TEST(Pool, RemoveWorkerFromItself) {
+    Pool pool(2);
+
+    for (int i = 0; i < 10 && pool.size() == 2; ++i) {
+        int id = -1;
+        bool removed = false;
+        pool.schedule([&] () -> void {
+            id = Worker::current()->id();
+            removed = pool.removeworker();
+        }).wait();
+        // Worker 1 is the one to go, and may not take itself down.
+        ASSERT_EQ(id != 1, removed);
+        ASSERT_EQ(removed ? 1 : 2, pool.size());
+    }
+}
+
+TEST(Pool, Domains) {
+    for (auto layout : {Pool::Layout::FLAT, Pool::Layout::LLC, Pool::Layout::NUMA}) {
+        for (auto scheduling : {Pool::Scheduling::SHARED, Pool::Scheduling::STEALING}) {
+            Pool::Options opts;
+            opts.layout = layout;
+            opts.scheduling = scheduling;
+            Pool pool(4, opts);
+
+            ASSERT_GE(pool.domains(), 1);
+            if (layout == Pool::Layout::FLAT) {
+                ASSERT_EQ(1, pool.domains());
+            }
+            for (int i = 0; i < 4; ++i) ASSERT_LT(pool.domain(i), pool.domains());
+
+            std::atomic<int> count{0};
+            std::vector<std::shared_future<void>> futures;
+            for (size_t i = 0; i < 100; ++i) {
+                futures.push_back(pool.schedule([&count] () -> void { ++count; }, Pool::Domain{i}));
+                futures.push_back(pool.schedule([&count] () -> void { ++count; }));
+            }
+            for (auto& f : futures) f.wait();
+            ASSERT_EQ(200, count.load());
+        }
+    }
+}
+
 TEST(Pool, TaskPriority) {
     using Instant = std::chrono::time_point<std::chrono::steady_clock>;
     using Delay = std::chrono::milliseconds;
@@ -311,3 +482,407 @@ TEST(Pool, SharedCallable) {
     shh_f.wait();
     ASSERT_EQ(123, shh->value());
 }
+
+TEST(Pool, StealingRunsTasks) {
+    Pool::Options opts;
+    opts.scheduling = Pool::Scheduling::STEALING;
+    Pool pool(3, opts);
+    std::atomic<int> n = 0;
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 0; i < 100; ++i) {
+        futures.push_back(pool.schedule([&n] () -> void {
+            ++n;
+        }));
+    }
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(100, n);
+    ASSERT_TRUE(pool.idle());
+}
+
+TEST(Pool, StealingLocalTasksAreLifo) {
+    Pool::Options opts;
+    opts.scheduling = Pool::Scheduling::STEALING;
+    Pool pool(1, opts);
+    std::vector<int> order;
+    std::shared_future<void> f1;
+    std::shared_future<void> f2;
+    pool.schedule([&] () -> void {
+        f1 = pool.schedule([&order] () -> void { order.push_back(1); });
+        f2 = pool.schedule([&order] () -> void { order.push_back(2); });
+    }).wait();
+    f1.wait();
+    f2.wait();
+    ASSERT_EQ(2, order.size());
+    ASSERT_EQ(2, order[0]);
+    ASSERT_EQ(1, order[1]);
+}
+
+TEST(Pool, StealingTaskPriority) {
+    Pool::Options opts;
+    opts.scheduling = Pool::Scheduling::STEALING;
+    Pool pool(2, opts);
+    std::vector<int> order;
+    std::mutex mtx;
+    auto record = [&order, &mtx] (int i) -> void {
+        std::unique_lock<std::mutex> lk(mtx);
+        order.push_back(i);
+    };
+    std::vector<std::shared_future<void>> futures;
+    pool.schedule([&] () -> void {
+        // Keep the other worker busy, so that the rest run in a known order.
+        futures.push_back(pool.schedule([] () -> void {
+            std::this_thread::sleep_for(300ms);
+        }, Task::MaxPriority));
+        std::this_thread::sleep_for(100ms);
+        futures.push_back(pool.schedule([&] () -> void { record(1); }, Task::MinPriority));
+        futures.push_back(pool.schedule([&] () -> void { record(2); }, Task::MaxPriority));
+        futures.push_back(pool.schedule([&] () -> void { record(3); }));
+    }).wait();
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(3, order.size());
+    ASSERT_EQ(2, order[0]);
+    ASSERT_EQ(3, order[1]);
+    ASSERT_EQ(1, order[2]);
+}
+
+TEST(Pool, RingMailbox) {
+    Pool::Options opts;
+    opts.mailbox = Worker::Mailbox::RING;
+    Pool pool(3, opts);
+    std::atomic<int> n = 0;
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 0; i < 100; ++i) {
+        futures.push_back(pool.schedule([&n] () -> void {
+            ++n;
+        }));
+    }
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(100, n);
+    pool.worker(1).name("ring_worker");
+    ASSERT_EQ("ring_worker", pool.worker(1).name());
+}
+
+TEST(Pool, WakeOneWorker) {
+    Pool pool(4);
+    ASSERT_EQ(4, pool.idleworkers());
+    pool.schedule([] () -> void {}).wait();
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(4, pool.idleworkers());
+
+    auto stats = pool.stats();
+    uint64_t wakeups = 0;
+    uint64_t wasted = 0;
+    for (const auto& s : stats) {
+        wakeups += s.wakeups;
+        wasted += s.wasted;
+    }
+    ASSERT_EQ(1, wakeups);
+    ASSERT_EQ(0, wasted);
+}
+
+TEST(Pool, BusyWorkerDrainsQueue) {
+    Pool pool(1);
+    std::atomic<int> n = 0;
+    std::vector<std::shared_future<void>> futures;
+    futures.push_back(pool.schedule([] () -> void {
+        std::this_thread::sleep_for(100ms);
+    }));
+    for (int i = 0; i < 10; ++i) {
+        futures.push_back(pool.schedule([&n] () -> void {
+            ++n;
+        }));
+    }
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(10, n);
+    // The wakeup is only counted once the worker parks again, which may be
+    // a little after the last task completed.
+    for (int i = 0; i < 1000 && pool.worker(0).stats().wakeups == 0; ++i) std::this_thread::sleep_for(1ms);
+    ASSERT_EQ(1, pool.worker(0).stats().wakeups);
+}
+
+TEST(Pool, SpinningWorkers) {
+    Pool::Options opts;
+    opts.spin = 1ms;
+    Pool pool(2, opts);
+    std::atomic<int> n = 0;
+    for (int i = 0; i < 50; ++i) {
+        pool.schedule([&n] () -> void {
+            ++n;
+        }).wait();
+    }
+    ASSERT_EQ(50, n);
+}
+
+TEST(Pool, ScheduleBatch) {
+    Pool pool(4);
+    std::atomic<int> n = 0;
+    std::vector<Task::Callable> tasks;
+    for (int i = 0; i < 1000; ++i) {
+        tasks.emplace_back([&n] () -> void {
+            ++n;
+        });
+    }
+    auto futures = pool.scheduleBatch(std::move(tasks));
+    ASSERT_EQ(1000, futures.size());
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(1000, n);
+
+    // Workers are woken per batch rather than per task. A worker that races
+    // with the batch while going idle may be woken more than once, though.
+    uint64_t wakeups = 0;
+    for (const auto& s : pool.stats()) wakeups += s.wakeups;
+    ASSERT_TRUE(wakeups < 100);
+}
+
+TEST(Pool, StealingScheduleBatch) {
+    Pool::Options opts;
+    opts.scheduling = Pool::Scheduling::STEALING;
+    Pool pool(3, opts);
+    std::atomic<int> n = 0;
+    std::vector<Task::Callable> tasks;
+    for (int i = 0; i < 100; ++i) {
+        tasks.emplace_back([&n] () -> void {
+            ++n;
+        });
+    }
+    for (auto& f : pool.scheduleBatch(std::move(tasks))) f.wait();
+    ASSERT_EQ(100, n);
+}
+
+TEST(Pool, Post) {
+    Pool pool(2);
+    std::promise<int> p;
+    auto f = p.get_future();
+    pool.post([&p] () -> void {
+        p.set_value(5);
+    });
+    ASSERT_EQ(5, f.get());
+}
+
+TEST(Pool, BucketQueueKeepsOrder) {
+    Pool::Options opts;
+    opts.queue = Pool::Queue::BUCKETS;
+    Pool pool(1, opts);
+    // Hold the only worker, so that everything below is queued before any
+    // of it runs.
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    auto held = pool.schedule([opened] () -> void {
+        opened.wait();
+    }, Task::MaxPriority);
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 0; i < 20; ++i) {
+        Task::Priority p = i % 2 ? Task::DefaultPriority : Task::DefaultPriority + 1;
+        futures.push_back(pool.schedule([i, &mutex, &order] () -> void {
+            std::unique_lock<std::mutex> lk(mutex);
+            order.push_back(i);
+        }, p));
+    }
+    gate.set_value();
+    for (auto& f : futures) f.wait();
+    std::vector<int> expected;
+    for (int i = 0; i < 20; i += 2) expected.push_back(i);
+    for (int i = 1; i < 20; i += 2) expected.push_back(i);
+    ASSERT_EQ(expected, order);
+}
+
+TEST(Pool, AgingLetsOldTasksThrough) {
+    Pool::Options opts;
+    opts.aging = 1ms;
+    Pool pool(1, opts);
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    auto held = pool.schedule([opened] () -> void {
+        opened.wait();
+    }, Task::MaxPriority);
+    std::mutex mutex;
+    std::vector<int> order;
+    auto record = [&mutex, &order] (int i) -> Task::Callable {
+        return [i, &mutex, &order] () -> void {
+            std::unique_lock<std::mutex> lk(mutex);
+            order.push_back(i);
+        };
+    };
+    auto low = pool.schedule(record(0), Task::MinPriority);
+    // Long enough for the low priority task to rank above anything.
+    std::this_thread::sleep_for(300ms);
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 1; i <= 5; ++i) futures.push_back(pool.schedule(record(i), Task::MaxPriority));
+    gate.set_value();
+    low.wait();
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5}), order);
+}
+
+TEST(Pool, Waits) {
+    Pool pool(1);
+    auto busy = pool.schedule([] () -> void {
+        std::this_thread::sleep_for(100ms);
+    });
+    auto queued = pool.schedule([] () -> void {}, 5);
+    busy.wait();
+    queued.wait();
+    auto waits = pool.waits();
+    ASSERT_EQ(1, waits.count(5));
+    ASSERT_TRUE(waits[5] >= 50ms);
+    ASSERT_EQ(0, waits.count(200));
+}
+
+TEST(Pool, EarliestDeadlineFirst) {
+    Pool::Options opts;
+    opts.queue = Pool::Queue::DEADLINE;
+    Pool pool(1, opts);
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    auto held = pool.schedule([opened] () -> void {
+        opened.wait();
+    });
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<std::shared_future<void>> futures;
+    auto now = Task::Clock::now();
+    futures.push_back(pool.schedule([&mutex, &order] () -> void {
+        std::unique_lock<std::mutex> lk(mutex);
+        order.push_back(-1);
+    }, Task::MaxPriority));
+    for (int i = 5; i > 0; --i) {
+        futures.push_back(pool.schedule([i, &mutex, &order] () -> void {
+            std::unique_lock<std::mutex> lk(mutex);
+            order.push_back(i);
+        }, now + i * 1h));
+    }
+    gate.set_value();
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(std::vector<int>({1, 2, 3, 4, 5, -1}), order);
+}
+
+// Aging does not apply to the DEADLINE queue, and must not get in its way.
+TEST(Pool, DeadlineIgnoresAging) {
+    Pool::Options opts;
+    opts.queue = Pool::Queue::DEADLINE;
+    opts.aging = 1ns;
+    Pool pool(1, opts);
+    std::promise<void> gate;
+    std::atomic<bool> started{false};
+    auto opened = gate.get_future().share();
+    auto held = pool.schedule([opened, &started] () -> void {
+        started = true;
+        opened.wait();
+    });
+    while (!started) std::this_thread::sleep_for(1ms);
+
+    std::vector<int> order;
+    std::vector<std::shared_future<void>> futures;
+    auto now = Task::Clock::now();
+    futures.push_back(pool.schedule([&order] () -> void { order.push_back(-1); }, Task::MaxPriority));
+    for (int i = 3; i > 0; --i) {
+        futures.push_back(pool.schedule([i, &order] () -> void { order.push_back(i); }, now + i * 1h));
+    }
+    std::this_thread::sleep_for(10ms);
+    gate.set_value();
+    for (auto& f : futures) f.wait();
+    ASSERT_EQ(std::vector<int>({1, 2, 3, -1}), order);
+}
+
+TEST(Pool, ExpiredTasksAreShed) {
+    Pool pool(1);
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    auto held = pool.schedule([opened] () -> void {
+        opened.wait();
+    }, Task::MaxPriority);
+    std::atomic<bool> ran = false;
+    auto late = pool.schedule([&ran] () -> void {
+        ran = true;
+    }, Task::Clock::now() + 10ms);
+    std::this_thread::sleep_for(50ms);
+    gate.set_value();
+    ASSERT_THROW(late.get(), DeadlineExceeded);
+    ASSERT_FALSE(ran);
+
+    auto early = pool.schedule([&ran] () -> void {
+        ran = true;
+    }, Task::Clock::now() + 1h);
+    early.get();
+    ASSERT_TRUE(ran);
+}
+
+TEST(Pool, ScheduleAfter) {
+    Pool pool(2);
+    std::promise<Task::Clock::time_point> ran;
+    auto when = ran.get_future();
+    auto start = Task::Clock::now();
+    pool.scheduleAfter(20ms, [&ran] () -> void {
+        ran.set_value(Task::Clock::now());
+    });
+    ASSERT_TRUE(when.get() >= start + 20ms);
+}
+
+TEST(Pool, ScheduleAtAndCancel) {
+    Pool pool(2);
+    std::atomic<int> n = 0;
+    auto timer = pool.scheduleAt(Task::Clock::now() + 50ms, [&n] () -> void {
+        ++n;
+    });
+    ASSERT_TRUE(timer.cancel());
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(0, n);
+}
+
+TEST(Pool, SchedulePeriodic) {
+    Pool pool(2);
+    std::atomic<int> n = 0;
+    auto timer = pool.schedulePeriodic(2ms, [&n] () -> void {
+        ++n;
+    });
+    while (n < 3) std::this_thread::sleep_for(1ms);
+    ASSERT_TRUE(timer.cancel());
+}
+
+TEST(Pool, CancelQueuedTasks) {
+    Pool pool(1);
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    auto held = pool.schedule([opened] () -> void {
+        opened.wait();
+    }, Task::MaxPriority);
+    std::stop_source source;
+    std::atomic<int> ran = 0;
+    std::vector<Task::Callable> tasks;
+    for (int i = 0; i < 100; ++i) {
+        tasks.emplace_back([&ran] () -> void {
+            ++ran;
+        });
+    }
+    auto futures = pool.scheduleBatch(std::move(tasks), source.get_token());
+    auto one = pool.schedule([&ran] () -> void {
+        ++ran;
+    }, source.get_token());
+    source.request_stop();
+    // The futures fail right away, while the tasks are still queued.
+    for (auto& f : futures) ASSERT_THROW(f.get(), TaskCancelled);
+    ASSERT_THROW(one.get(), TaskCancelled);
+    gate.set_value();
+    held.wait();
+    pool.schedule([] () -> void {}, Task::MinPriority).wait();
+    ASSERT_EQ(0, ran);
+}
+
+TEST(Pool, RunningTaskPollsToken) {
+    Pool pool(2);
+    std::stop_source source;
+    std::atomic<bool> started = false;
+    auto token = source.get_token();
+    auto f = pool.schedule([token, &started] () -> void {
+        started = true;
+        while (!token.stop_requested()) std::this_thread::yield();
+    }, token);
+    while (!started) std::this_thread::yield();
+    source.request_stop();
+    f.get();
+
+    auto late = pool.schedule([] () -> void {}, token);
+    ASSERT_THROW(late.get(), TaskCancelled);
+}
@@ -82,3 +82,51 @@ TEST(PriorityQueue, TryPop) {
     ASSERT_EQ(200, pq.trypop());
     ASSERT_EQ(std::nullopt, pq.trypop());
 }
+
+TEST(BucketQueue, EmptyQueue) {
+    BucketQueue<std::string> bq;
+    ASSERT_TRUE(bq.empty());
+    ASSERT_EQ(0, bq.size());
+    ASSERT_FALSE(bq.trypop().has_value());
+}
+
+TEST(BucketQueue, MaxFirst) {
+    BucketQueue<std::string> bq;
+    bq.push(3, "three");
+    bq.push(200, "two hundred");
+    bq.push(64, "sixty four");
+    bq.push(0, "zero");
+    ASSERT_EQ(4, bq.size());
+    ASSERT_EQ(200, bq.priority());
+    uint8_t k;
+    ASSERT_EQ("two hundred", bq.pop(&k));
+    ASSERT_EQ(200, k);
+    ASSERT_EQ("sixty four", bq.pop());
+    ASSERT_EQ("three", bq.pop());
+    ASSERT_EQ("zero", bq.pop());
+    ASSERT_TRUE(bq.empty());
+}
+
+TEST(BucketQueue, MinFirst) {
+    BucketQueue<std::string, MinFirst> bq;
+    bq.push(255, "last");
+    bq.push(128, "middle");
+    bq.push(1, "first");
+    ASSERT_EQ("first", bq.peek());
+    ASSERT_EQ("first", bq.pop());
+    ASSERT_EQ("middle", bq.pop());
+    ASSERT_EQ("last", bq.pop());
+}
+
+TEST(BucketQueue, FifoWithinPriority) {
+    BucketQueue<int> bq;
+    std::vector<int> batch = {10, 11, 12};
+    for (int i = 0; i < 5; ++i) bq.push(7, i);
+    bq.push(7, batch.begin(), batch.end());
+    bq.push(9, 100);
+    ASSERT_EQ(9, bq.size());
+    ASSERT_EQ(100, bq.pop());
+    for (int i = 0; i < 5; ++i) ASSERT_EQ(i, bq.pop());
+    for (int i : batch) ASSERT_EQ(i, bq.trypop().value());
+    ASSERT_TRUE(bq.empty());
+}
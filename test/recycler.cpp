@@ -0,0 +1,122 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/recycler.h>
+#include <beehive/beehive.h>
+#include "gtest/gtest.h"
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+
+using namespace beehive;
+
+// Counts every heap allocation made by the test binary and the library,
+// from any thread.
+static std::atomic<uint64_t> gNews{0};
+
+void* operator new(size_t n) {
+    ++gNews;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+TEST(Recycler, ReusesBlocks) {
+    void* p = Recycler::allocate(100);
+    Recycler::deallocate(p, 100);
+    auto before = Recycler::stats();
+    void* q = Recycler::allocate(120);
+    auto after = Recycler::stats();
+    ASSERT_EQ(p, q);
+    ASSERT_EQ(before.hits + 1, after.hits);
+    ASSERT_EQ(before.misses, after.misses);
+    Recycler::deallocate(q, 120);
+}
+
+TEST(Recycler, LargeBlocks) {
+    auto before = Recycler::stats();
+    void* p = Recycler::allocate(Recycler::MaxSize + 1);
+    Recycler::deallocate(p, Recycler::MaxSize + 1);
+    auto after = Recycler::stats();
+    ASSERT_EQ(before.hits, after.hits);
+    ASSERT_EQ(before.misses, after.misses);
+}
+
+TEST(Recycler, RemoteFree) {
+    void* p = Recycler::allocate(64);
+    std::thread t1([p] () -> void {
+        Recycler::deallocate(p, 64);
+    });
+    t1.join();
+    std::vector<void*> blocks;
+    bool found = false;
+    while (!found && blocks.size() < 10000) {
+        blocks.push_back(Recycler::allocate(64));
+        found = (blocks.back() == p);
+    }
+    for (auto b : blocks) Recycler::deallocate(b, 64);
+    ASSERT_TRUE(found);
+}
+
+TEST(Recycler, Allocator) {
+    auto p = std::allocate_shared<int>(RecyclingAllocator<int>(), 42);
+    ASSERT_EQ(42, *p);
+    std::vector<int, RecyclingAllocator<int>> v(1000, 3);
+    ASSERT_EQ(3, v[999]);
+}
+
+// Warms up with a few tasks in flight at a time, so that a worker running
+// late later on does not drain the free lists.
+TEST(Recycler, SteadyStateScheduling) {
+    Beehive beehive(2);
+    for (int i = 0; i < 100; ++i) {
+        std::vector<Future<int>> futures;
+        for (int j = 0; j < 16; ++j) futures.push_back(beehive.schedule([] (int x) -> int { return x; }, j));
+        for (auto& f : futures) f.wait();
+    }
+    auto before = Recycler::stats();
+    auto news = gNews.load();
+    for (int i = 0; i < 1000; ++i) {
+        beehive.schedule([] (int x) -> int { return x; }, i).wait();
+    }
+    auto after = Recycler::stats();
+    ASSERT_EQ(news, gNews.load());
+    ASSERT_EQ(before.misses, after.misses);
+    ASSERT_TRUE(after.hits >= before.hits + 1000);
+}
+
+TEST(Recycler, SteadyStatePoolScheduling) {
+    Pool pool(2);
+    for (int i = 0; i < 100; ++i) {
+        std::vector<std::shared_future<void>> futures;
+        for (int j = 0; j < 16; ++j) futures.push_back(pool.schedule([] () -> void {}));
+        for (auto& f : futures) f.wait();
+    }
+    auto news = gNews.load();
+    for (int i = 0; i < 1000; ++i) {
+        pool.schedule([] () -> void {}).wait();
+    }
+    ASSERT_EQ(news, gNews.load());
+}
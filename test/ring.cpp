@@ -0,0 +1,97 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/ring.h>
+#include "gtest/gtest.h"
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace beehive;
+
+TEST(RingBuffer, Capacity) {
+    RingBuffer<int> rb(100);
+    ASSERT_EQ(128, rb.capacity());
+    ASSERT_TRUE(rb.empty());
+}
+
+TEST(RingBuffer, PushPop) {
+    RingBuffer<std::string> rb(4);
+    std::string s = "hello";
+    ASSERT_TRUE(rb.trypush(s));
+    ASSERT_FALSE(rb.empty());
+    ASSERT_EQ("hello", rb.trypop());
+    ASSERT_TRUE(rb.empty());
+    ASSERT_EQ(std::nullopt, rb.trypop());
+}
+
+TEST(RingBuffer, Full) {
+    RingBuffer<int> rb(2);
+    int a = 1, b = 2, c = 3;
+    ASSERT_TRUE(rb.trypush(a));
+    ASSERT_TRUE(rb.trypush(b));
+    ASSERT_FALSE(rb.trypush(c));
+    ASSERT_EQ(3, c);
+    ASSERT_EQ(1, rb.trypop());
+    ASSERT_TRUE(rb.trypush(c));
+    ASSERT_EQ(2, rb.trypop());
+    ASSERT_EQ(3, rb.trypop());
+}
+
+TEST(RingBuffer, DestroysLeftovers) {
+    auto p = std::make_shared<int>(1);
+    {
+        RingBuffer<std::shared_ptr<int>> rb(4);
+        auto q = p;
+        rb.trypush(q);
+        ASSERT_EQ(2, p.use_count());
+    }
+    ASSERT_EQ(1, p.use_count());
+}
+
+TEST(RingBuffer, ManyProducersManyConsumers) {
+    constexpr int PRODUCERS = 4;
+    constexpr int CONSUMERS = 4;
+    constexpr int ITEMS = 10000;
+    RingBuffer<int> rb(64);
+    std::atomic<long> sum = 0;
+    std::atomic<int> received = 0;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        threads.emplace_back([&rb] () -> void {
+            for (int i = 1; i <= ITEMS; ++i) {
+                int v = i;
+                while (!rb.trypush(v)) std::this_thread::yield();
+            }
+        });
+    }
+    for (int c = 0; c < CONSUMERS; ++c) {
+        threads.emplace_back([&] () -> void {
+            while (received.load() < PRODUCERS * ITEMS) {
+                if (auto v = rb.trypop()) {
+                    sum += *v;
+                    ++received;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    ASSERT_EQ(PRODUCERS * ITEMS, received.load());
+    ASSERT_EQ(PRODUCERS * (long)ITEMS * (ITEMS + 1) / 2, sum.load());
+}
@@ -27,3 +27,13 @@ TEST(Task, Execution) {
     t.run();
     ASSERT_EQ(1, n);
 }
+
+TEST(Task, MoveOnlyCallable) {
+    int n = 0;
+    auto p = std::make_unique<int>(7);
+    Task t([&n, p = std::move(p)] () -> void {
+        n = *p;
+    });
+    t.run();
+    ASSERT_EQ(7, n);
+}
@@ -0,0 +1,130 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/timer.h>
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace beehive;
+using namespace std::chrono_literals;
+
+namespace {
+// Runs timers right on the timer thread, and records when each one ran.
+struct Recorder {
+    std::mutex mutex;
+    std::vector<std::pair<int, TimerWheel::Clock::time_point>> runs;
+
+    TimerWheel::Dispatch dispatch() {
+        return [] (Task::Callable c, Task::Priority) -> void { c(); };
+    }
+
+    Task::Callable record(int i) {
+        return [this, i] () -> void {
+            std::unique_lock<std::mutex> lk(mutex);
+            runs.emplace_back(i, TimerWheel::Clock::now());
+        };
+    }
+
+    size_t size() {
+        std::unique_lock<std::mutex> lk(mutex);
+        return runs.size();
+    }
+
+    void waitfor(size_t n) {
+        while (size() < n) std::this_thread::sleep_for(1ms);
+    }
+};
+}
+
+TEST(TimerWheel, FiresInOrder) {
+    Recorder r;
+    TimerWheel wheel(r.dispatch(), 100us);
+    auto now = TimerWheel::Clock::now();
+    wheel.add(now + 30ms, r.record(3));
+    wheel.add(now + 5ms, r.record(1));
+    wheel.add(now + 15ms, r.record(2));
+    r.waitfor(3);
+    ASSERT_EQ(1, r.runs[0].first);
+    ASSERT_EQ(2, r.runs[1].first);
+    ASSERT_EQ(3, r.runs[2].first);
+    ASSERT_TRUE(r.runs[0].second >= now + 5ms);
+    ASSERT_TRUE(r.runs[2].second >= now + 30ms);
+    ASSERT_EQ(0, wheel.size());
+}
+
+TEST(TimerWheel, AllLevels) {
+    // With 1us ticks, these land on each of the four levels.
+    Recorder r;
+    TimerWheel wheel(r.dispatch(), 1us);
+    auto now = TimerWheel::Clock::now();
+    std::vector<TimerWheel::Clock::duration> delays = {400ms, 100ms, 2ms, 50us};
+    for (size_t i = 0; i < delays.size(); ++i) wheel.add(now + delays[i], r.record(i));
+    ASSERT_TRUE(wheel.size() <= 4);
+    r.waitfor(4);
+    for (size_t i = 0; i < 4; ++i) {
+        auto [which, when] = r.runs[i];
+        ASSERT_EQ(3 - i, which);
+        ASSERT_TRUE(when >= now + delays[which]);
+    }
+}
+
+TEST(TimerWheel, Cancel) {
+    Recorder r;
+    TimerWheel wheel(r.dispatch());
+    auto timer = wheel.add(TimerWheel::Clock::now() + 50ms, r.record(0));
+    ASSERT_EQ(1, wheel.size());
+    ASSERT_TRUE(timer.cancel());
+    ASSERT_FALSE(timer.cancel());
+    ASSERT_EQ(0, wheel.size());
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(0, r.size());
+}
+
+TEST(TimerWheel, Periodic) {
+    Recorder r;
+    TimerWheel wheel(r.dispatch());
+    auto timer = wheel.add(TimerWheel::Clock::now(), 5ms, r.record(0));
+    r.waitfor(3);
+    ASSERT_TRUE(timer.cancel());
+    auto n = r.size();
+    std::this_thread::sleep_for(50ms);
+    ASSERT_TRUE(r.size() <= n + 1);
+}
+
+TEST(TimerWheel, SlackCoalesces) {
+    Recorder r;
+    auto start = TimerWheel::Clock::now();
+    TimerWheel wheel(r.dispatch(), 1ms, 50ms);
+    auto now = TimerWheel::Clock::now();
+    for (int i = 1; i <= 4; ++i) wheel.add(now + i * 1ms, r.record(i));
+    r.waitfor(4);
+    // All four were pushed back to the first 50ms boundary of the wheel.
+    for (auto& [which, when] : r.runs) ASSERT_TRUE(when >= start + 50ms);
+}
+
+TEST(TimerWheel, Stop) {
+    Recorder r;
+    TimerWheel wheel(r.dispatch());
+    auto timer = wheel.add(TimerWheel::Clock::now() + 1h, r.record(0));
+    wheel.stop();
+    ASSERT_EQ(0, wheel.size());
+    ASSERT_FALSE(timer.cancel());
+    ASSERT_FALSE(wheel.add(TimerWheel::Clock::now(), r.record(1)).cancel());
+}
@@ -0,0 +1,119 @@
+/*
+Copyright 2020 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <beehive/trace.h>
+#include <beehive/pool.h>
+#include "gtest/gtest.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+using namespace beehive;
+
+namespace {
+size_t occurrences(const std::string& s, const std::string& what) {
+    size_t n = 0;
+    for (auto i = s.find(what); i != std::string::npos; i = s.find(what, i + 1)) ++n;
+    return n;
+}
+}
+
+TEST(TraceBuffer, KeepsLatest) {
+    TraceBuffer tb(4);
+    ASSERT_TRUE(tb.records().empty());
+
+    for (uint64_t i = 0; i < 10; ++i) tb.add(TraceBuffer::Event::START, i, i + 1);
+    auto r = tb.records();
+    // The slot the writer would go to next counts as stale.
+    ASSERT_EQ(3, r.size());
+    for (size_t i = 0; i < r.size(); ++i) {
+        ASSERT_EQ(TraceBuffer::Event::START, r[i].event);
+        ASSERT_EQ(7 + i, r[i].arg);
+        ASSERT_EQ(8 + i, r[i].extra);
+        if (i > 0) {
+            ASSERT_LE(r[i - 1].time, r[i].time);
+        }
+    }
+}
+
+TEST(TraceBuffer, ChromeFormat) {
+    TraceBuffer tb(16);
+    tb.add(TraceBuffer::Event::ENQUEUE, 0xabc, 5);
+    tb.add(TraceBuffer::Event::END, 0xabc, 5);
+    tb.add(TraceBuffer::Event::START, 0xabc, 5);
+    tb.add(TraceBuffer::Event::END, 0xabc, 5);
+    tb.add(TraceBuffer::Event::PARK);
+    tb.add(TraceBuffer::Event::WAKEUP);
+
+    std::ostringstream ss;
+    writeChromeTrace(ss, {TraceTrack{3, "worker[3]", tb.records()}});
+    auto json = ss.str();
+
+    ASSERT_EQ(0, json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    ASSERT_NE(std::string::npos, json.find("\"args\":{\"name\":\"worker[3]\"}"));
+    ASSERT_NE(std::string::npos, json.find("\"task\":\"0xabc\",\"priority\":5"));
+    // A task and a parked span. The first END has no START to close.
+    ASSERT_EQ(2, occurrences(json, "\"ph\":\"B\""));
+    ASSERT_EQ(2, occurrences(json, "\"ph\":\"E\""));
+    ASSERT_EQ(1, occurrences(json, "\"ph\":\"s\""));
+    ASSERT_EQ(1, occurrences(json, "\"ph\":\"f\""));
+}
+
+TEST(TraceBuffer, ChromeFormatEscapesNames) {
+    std::ostringstream ss;
+    writeChromeTrace(ss, {TraceTrack{0, "a\"b\\c\nd", {}}});
+    ASSERT_NE(std::string::npos, ss.str().find("{\"name\":\"a\\\"b\\\\c\\u000ad\"}"));
+}
+
+TEST(TraceBuffer, PoolDumpTrace) {
+    auto path = std::filesystem::temp_directory_path() / ("beehive-trace-" + std::to_string(getpid()) + ".json");
+
+    Pool untraced(1);
+    ASSERT_FALSE(untraced.dumpTrace(path.string()));
+
+    Pool::Options opts;
+    opts.tracing = 1024;
+    Pool pool(2, opts);
+    // Names end up in the JSON, and must be escaped there.
+    pool.worker(1).name("w\"1\\");
+    while (pool.worker(1).name() != "w\"1\\") std::this_thread::yield();
+    std::vector<std::shared_future<void>> futures;
+    for (int i = 0; i < 10; ++i) {
+        futures.push_back(pool.schedule([&pool] () -> void {
+            pool.schedule([] () -> void {});
+        }));
+    }
+    for (auto& f : futures) f.wait();
+    while (pool.idleworkers() < 2 || !pool.idle()) std::this_thread::yield();
+
+    ASSERT_TRUE(pool.dumpTrace(path.string()));
+    std::ifstream f(path);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    std::filesystem::remove(path);
+    auto json = ss.str();
+
+    ASSERT_NE(std::string::npos, json.find("\"worker[0]\""));
+    ASSERT_NE(std::string::npos, json.find("\"w\\\"1\\\\\""));
+    ASSERT_NE(std::string::npos, json.find("\"outside\""));
+    ASSERT_EQ(20, occurrences(json, "\"name\":\"enqueue\""));
+    ASSERT_EQ(20, occurrences(json, "\"name\":\"task\",\"ph\":\"B\""));
+    ASSERT_EQ(20, occurrences(json, "\"name\":\"task\",\"ph\":\"E\""));
+    ASSERT_EQ(20, occurrences(json, "\"ph\":\"f\""));
+    ASSERT_LT(0, occurrences(json, "\"kind\":\"TASK\""));
+}